@@ -0,0 +1,762 @@
+//
+// benchmarks for the converter, printing one JSON object per result so that runs can be compared by scripts
+// build: gcc -O2 -pthread -o bench bench.c
+//
+
+#include "simd.h"
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <sys/resource.h>
+#endif
+
+#if defined(Y4M_X86) && !defined(_MSC_VER)
+#include <x86intrin.h> // __rdtsc() (MSVC has it in intrin.h, which simd.h includes)
+#endif
+
+#define SORT_PREFIX "/renders/shot_042/frame_" // typical of the paths main.c builds up
+#define CONV_MIN_NS 200000000ull // each kernel is run over & over for at least this long
+#define E2E_DIR "/dev/shm" // tmpfs on Linux, so that the BMPs are read from memory rather than from a disk
+#define E2E_FALLBACK_DIR "/tmp"
+#define CHECK_MIN_NS 50000000ull // likewise when timing the kernels checked for accuracy
+#define CHECK_TOLERANCE 1 // largest difference from the reference kernels allowed for any sample
+#define ALL_COLOURS_SIDE 4096 // the frame holding every 24-bit colour once is this many pixels square
+
+static const struct {
+    const char *name;
+    conv_backend backend;
+    simd_level level; // needed to run it
+} backends[] = {{"ref", CONV_REF, SIMD_NONE}, {"fixed", CONV_FIXED, SIMD_NONE}, {"lut", CONV_LUT, SIMD_NONE},
+                {"sse2", CONV_SSE2, SIMD_SSE2}, {"avx2", CONV_AVX2, SIMD_AVX2}, {"avx512", CONV_AVX512, SIMD_AVX512}};
+
+#define NUM_BACKENDS (sizeof(backends)/sizeof(*backends))
+
+static const char *const subs[] = {"444", "422", "420", "411", "410"};
+static const unsigned int h_subs[] = {1, 2, 2, 4, 4};
+static const unsigned int v_subs[] = {1, 1, 2, 1, 2};
+
+static inline conv_kernel get_kernel(const conv_kernels *kernels, int sub) { // sub indexes subs[]
+    const conv_kernel funcs[] = {kernels->out_444, kernels->out_422, kernels->out_420, kernels->out_411,
+                                 kernels->out_410};
+    return funcs[sub];
+}
+
+static inline unsigned long long read_tsc(void) { // 0 where there's no time-stamp counter to read
+#ifdef Y4M_X86
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static unsigned long long rng_state = 0x9e3779b97f4a7c15ull;
+
+static inline unsigned long long next_rand(void) { // xorshift64 - deterministic, so every run sorts the same input
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+// times one sort of count un-padded frame paths ("..._frame_1234.bmp"), in a random order
+static void bench_sort(size_t count, bool natural) {
+    const char **array = malloc((count + 1)*sizeof(const char *));
+    if (!array) {
+        fprintf(stderr, "Memory allocation error when creating %zu paths.\n", count);
+        abort();
+    }
+    char *str;
+    for (size_t i = 0; i < count; ++i) {
+        str = malloc(sizeof(SORT_PREFIX) + 24);
+        if (!str) {
+            fprintf(stderr, "Memory allocation error when creating %zu paths.\n", count);
+            abort();
+        }
+        sprintf(str, SORT_PREFIX "%zu.bmp", i);
+        *(array + i) = str;
+    }
+    *(array + count) = NULL;
+    const char *temp;
+    size_t j;
+    for (size_t i = count - 1; i > 0; --i) { // Fisher-Yates shuffle
+        j = (size_t) (next_rand() % (i + 1));
+        temp = *(array + i);
+        *(array + i) = *(array + j);
+        *(array + j) = temp;
+    }
+    unsigned long long start = get_time_ns();
+    if (natural)
+        natural_sort(array);
+    else
+        alphabetical_sort(array);
+    unsigned long long elapsed = get_time_ns() - start;
+    bool sorted = true;
+    for (size_t i = 1; i < count; ++i)
+        if ((natural ? natcmp_c : alfcmp_c)(*(array + i - 1), *(array + i)) > 0)
+            sorted = false;
+    printf("{\"bench\": \"sort\", \"order\": \"%s\", \"entries\": %zu, \"ms\": %.3f, \"sorted\": %s}\n",
+           natural ? "natural" : "alpha", count, elapsed/1e6, sorted ? "true" : "false");
+    fflush(stdout);
+    free_array(array);
+}
+
+// times each conversion backend the CPU supports on a frame of random pixels, for every sub-sampling
+static void bench_conv(unsigned int width, unsigned int height) {
+    width -= width % 4; // every sub-sampling can then be used as is
+    height -= height % 2;
+    size_t row_size = ((size_t) width)*sizeof(colour);
+    size_t px_size = row_size*height;
+    unsigned char *pixels = malloc(px_size);
+    unsigned char *out = malloc(px_size); // as big as a 4:4:4 frame
+    if (!pixels || !out || !width || !height) {
+        fprintf(stderr, "Memory allocation error when creating a %ux%u frame.\n", width, height);
+        abort();
+    }
+    for (size_t i = 0; i < px_size; ++i)
+        *(pixels + i) = (unsigned char) next_rand();
+    const colour *input = (const colour *) (pixels + (height - 1)*row_size); // walked bottom-up, as a BMP is
+    simd_level level = get_simd_level();
+    size_t luma_size = ((size_t) width)*height;
+    for (size_t b = 0; b < NUM_BACKENDS; ++b) {
+        if (backends[b].level > level)
+            continue;
+        const conv_kernels *kernels = get_kernels(backends[b].backend);
+        for (int s = 0; s < 5; ++s) {
+            size_t chroma_size = luma_size/(h_subs[s]*v_subs[s]);
+            unsigned long long start = get_time_ns();
+            unsigned long long elapsed;
+            size_t runs = 0;
+            do {
+                get_kernel(kernels, s)(input, -(ptrdiff_t) row_size, out, out + luma_size, out + luma_size + chroma_size, width,
+                         height);
+                ++runs;
+            } while ((elapsed = get_time_ns() - start) < CONV_MIN_NS);
+            double ms = elapsed/1e6/runs;
+            printf("{\"bench\": \"conv\", \"backend\": \"%s\", \"sub\": \"%s\", \"width\": %u, \"height\": %u, "
+                   "\"ms\": %.3f, \"mpix_per_s\": %.1f}\n", backends[b].name, subs[s], width, height, ms,
+                   luma_size/ms/1e3);
+            fflush(stdout);
+        }
+    }
+    free_ptrs(2, pixels, out);
+}
+
+typedef enum {
+    FRAME_NOISE, FRAME_PURE, FRAME_GRADIENT_H, FRAME_GRADIENT_V, FRAME_CHECKER, FRAME_ALL_COLOURS
+} check_frame_kind;
+
+typedef struct { // one of the frames the kernels are checked on
+    const char *name;
+    check_frame_kind kind;
+    unsigned int rgb; // colour of a pure frame (0xRRGGBB)
+} check_frame;
+
+static const check_frame check_frames[] = {
+        {"noise", FRAME_NOISE, 0}, {"black", FRAME_PURE, 0x000000}, {"white", FRAME_PURE, 0xffffff},
+        {"red", FRAME_PURE, 0xff0000}, {"green", FRAME_PURE, 0x00ff00}, {"blue", FRAME_PURE, 0x0000ff},
+        {"cyan", FRAME_PURE, 0x00ffff}, {"magenta", FRAME_PURE, 0xff00ff}, {"yellow", FRAME_PURE, 0xffff00},
+        {"gradient_h", FRAME_GRADIENT_H, 0}, {"gradient_v", FRAME_GRADIENT_V, 0}, {"checker", FRAME_CHECKER, 0},
+        {"all_colours", FRAME_ALL_COLOURS, 0}};
+
+#define NUM_CHECK_FRAMES (sizeof(check_frames)/sizeof(*check_frames))
+
+typedef struct { // differences from the reference kernel's output, over every frame checked
+    int max_diff[3]; // per plane (Y, Cb & Cr)
+    unsigned long long sum_diff[3];
+    size_t samples[3];
+    const char *worst_frame; // the first frame on which the largest difference in any plane was found
+    int worst_diff;
+} check_result;
+
+// fills a BMP-style pixel array (rows row_size bytes apart, padding zeroed) with the frame's pattern
+static void fill_check_frame(const check_frame *frame, unsigned char *pixels, unsigned int width, unsigned int height,
+                             size_t row_size) {
+    unsigned char *px;
+    unsigned int rgb;
+    for (unsigned int y = 0; y < height; ++y) {
+        px = pixels + y*row_size;
+        for (unsigned int x = 0; x < width; ++x, px += sizeof(colour)) {
+            switch (frame->kind) {
+                case FRAME_NOISE:
+                    rgb = (unsigned int) next_rand();
+                    break;
+                case FRAME_PURE:
+                    rgb = frame->rgb;
+                    break;
+                case FRAME_GRADIENT_H: // R rising & G falling across, B rising down
+                    rgb = (x*255/(width - 1)) << 16 | (255 - x*255/(width - 1)) << 8 | y*255/(height - 1);
+                    break;
+                case FRAME_GRADIENT_V: // every channel rising down, at different rates
+                    rgb = (y*255/(height - 1)) << 16 | (y*511/(height - 1) & 255) << 8 | (y*1023/(height - 1) & 255);
+                    break;
+                case FRAME_CHECKER: // the most extreme chroma averages: black & white alternating every pixel
+                    rgb = (x ^ y) & 1 ? 0xffffff : 0;
+                    break;
+                default: // FRAME_ALL_COLOURS - each pixel's index is its colour
+                    rgb = (unsigned int) (((size_t) y)*width + x) & 0xffffff;
+                    break;
+            }
+            ((colour *) px)->r = (unsigned char) (rgb >> 16);
+            ((colour *) px)->g = (unsigned char) (rgb >> 8);
+            ((colour *) px)->b = (unsigned char) rgb;
+        }
+        for (size_t x = ((size_t) width)*sizeof(colour); x < row_size; ++x)
+            *(pixels + y*row_size + x) = 0;
+    }
+}
+
+static void compare_planes(check_result *res, const check_frame *frame, const unsigned char *out,
+                           const unsigned char *ref, size_t luma_size, size_t chroma_size) {
+    size_t offset = 0;
+    int diff;
+    for (int p = 0; p < 3; ++p) {
+        size_t plane_size = p ? chroma_size : luma_size;
+        for (size_t i = offset; i < offset + plane_size; ++i) {
+            diff = *(out + i) - *(ref + i);
+            diff = diff < 0 ? -diff : diff;
+            res->sum_diff[p] += (unsigned int) diff;
+            if (diff > res->max_diff[p])
+                res->max_diff[p] = diff;
+            if (diff > res->worst_diff) {
+                res->worst_diff = diff;
+                res->worst_frame = frame->name;
+            }
+        }
+        res->samples[p] += plane_size;
+        offset += plane_size;
+    }
+}
+
+/* checks every backend the CPU supports against the reference (long double) kernels, for every sub-sampling, on each
+ * of check_frames - all width x height, trimmed for each sub-sampling as main.c does, bar the frame holding every
+ * colour - then times each kernel on the noise frame, in nanoseconds & in time-stamp counter cycles (which tick at the
+ * CPU's base clock rather than its current one). Returns false if any sample differs by more than the tolerance */
+static bool bench_check(unsigned int width, unsigned int height) {
+    size_t row_size = ((size_t) width)*sizeof(colour) + PAD_24BPP(width);
+    size_t max_px = ((size_t) ALL_COLOURS_SIDE)*ALL_COLOURS_SIDE;
+    if (max_px < ((size_t) width)*height)
+        max_px = ((size_t) width)*height;
+    unsigned char *pixels = malloc(max_px*sizeof(colour) + ((size_t) height)*sizeof(colour)); // room for padding
+    unsigned char *ref = malloc(max_px*sizeof(colour)); // as big as a 4:4:4 frame
+    unsigned char *out = malloc(max_px*sizeof(colour));
+    check_result *results = calloc(NUM_BACKENDS*5, sizeof(check_result));
+    if (!pixels || !ref || !out || !results) {
+        fprintf(stderr, "Memory allocation error when creating the frames to check.\n");
+        abort();
+    }
+    simd_level level = get_simd_level();
+    const conv_kernels *ref_kernels = get_kernels(CONV_REF);
+    for (size_t f = 0; f < NUM_CHECK_FRAMES; ++f) {
+        const check_frame *frame = check_frames + f;
+        unsigned int bmp_width = frame->kind == FRAME_ALL_COLOURS ? ALL_COLOURS_SIDE : width;
+        unsigned int bmp_height = frame->kind == FRAME_ALL_COLOURS ? ALL_COLOURS_SIDE : height;
+        size_t bmp_row_size = ((size_t) bmp_width)*sizeof(colour) + PAD_24BPP(bmp_width);
+        fill_check_frame(frame, pixels, bmp_width, bmp_height, bmp_row_size);
+        for (int s = 0; s < 5; ++s) {
+            unsigned int w = bmp_width - bmp_width % h_subs[s]; // the odd column(s) & row are trimmed off
+            unsigned int h = bmp_height - bmp_height % v_subs[s];
+            size_t luma_size = ((size_t) w)*h;
+            size_t chroma_size = luma_size/(h_subs[s]*v_subs[s]);
+            const colour *input = (const colour *) (pixels + (h - 1)*bmp_row_size); // as in read_frame()
+            ptrdiff_t stride = -(ptrdiff_t) bmp_row_size;
+            get_kernel(ref_kernels, s)(input, stride, ref, ref + luma_size, ref + luma_size + chroma_size, w, h);
+            for (size_t b = 0; b < NUM_BACKENDS; ++b) {
+                check_result *res = results + 5*b + s;
+                if (backends[b].level > level)
+                    continue;
+                if (backends[b].backend == CONV_REF) { // no need to compare it against itself
+                    compare_planes(res, frame, ref, ref, luma_size, chroma_size);
+                    continue;
+                }
+                get_kernel(get_kernels(backends[b].backend), s)(input, stride, out, out + luma_size,
+                                                                 out + luma_size + chroma_size, w, h);
+                compare_planes(res, frame, out, ref, luma_size, chroma_size);
+            }
+        }
+    }
+    fill_check_frame(check_frames, pixels, width, height, row_size); // the noise frame, for the timings
+    bool pass = true;
+    for (size_t b = 0; b < NUM_BACKENDS; ++b) {
+        if (backends[b].level > level)
+            continue;
+        const conv_kernels *kernels = get_kernels(backends[b].backend);
+        for (int s = 0; s < 5; ++s) {
+            check_result *res = results + 5*b + s;
+            unsigned int w = width - width % h_subs[s];
+            unsigned int h = height - height % v_subs[s];
+            size_t luma_size = ((size_t) w)*h;
+            size_t chroma_size = luma_size/(h_subs[s]*v_subs[s]);
+            const colour *input = (const colour *) (pixels + (h - 1)*row_size);
+            unsigned long long best_ns = 0;
+            unsigned long long best_cycles = 0;
+            unsigned long long start = get_time_ns();
+            unsigned long long ns;
+            unsigned long long cycles;
+            do { // the fastest run is the one least disturbed by anything else
+                ns = get_time_ns();
+                cycles = read_tsc();
+                get_kernel(kernels, s)(input, -(ptrdiff_t) row_size, out, out + luma_size,
+                                       out + luma_size + chroma_size, w, h);
+                cycles = read_tsc() - cycles;
+                ns = get_time_ns() - ns;
+                if (!best_ns || ns < best_ns) {
+                    best_ns = ns;
+                    best_cycles = cycles;
+                }
+            } while (get_time_ns() - start < CHECK_MIN_NS);
+            bool ok = res->max_diff[0] <= CHECK_TOLERANCE && res->max_diff[1] <= CHECK_TOLERANCE &&
+                      res->max_diff[2] <= CHECK_TOLERANCE;
+            pass = pass && ok;
+            printf("{\"bench\": \"check\", \"backend\": \"%s\", \"sub\": \"%s\", \"frames\": %zu, "
+                   "\"max_diff\": [%d, %d, %d], \"mean_diff\": [%.6f, %.6f, %.6f], \"worst_frame\": %s%s%s, "
+                   "\"ns_per_px\": %.3f, \"cycles_per_px\": %.3f, \"pass\": %s}\n", backends[b].name, subs[s],
+                   NUM_CHECK_FRAMES, res->max_diff[0], res->max_diff[1], res->max_diff[2],
+                   (double) res->sum_diff[0]/res->samples[0], (double) res->sum_diff[1]/res->samples[1],
+                   (double) res->sum_diff[2]/res->samples[2], res->worst_frame ? "\"" : "",
+                   res->worst_frame ? res->worst_frame : "null", res->worst_frame ? "\"" : "",
+                   (double) best_ns/luma_size, (double) best_cycles/luma_size, ok ? "true" : "false");
+            fflush(stdout);
+        }
+    }
+    free_ptrs(4, pixels, ref, out, results);
+    return pass;
+}
+
+typedef struct { // settings of the end-to-end benchmark
+    const char *converter; // path of the converter's executable
+    unsigned int width;
+    unsigned int height;
+    unsigned int frames;
+    unsigned int bpp; // 24 or 32
+    bool noise; // random pixels if true, otherwise each frame is a single colour (a different one for every frame)
+    unsigned int runs; // the fastest of this many runs of each sub-sampling is reported
+    const char *dir; // where the temporary directory holding the BMPs is made
+    char **extra; // arguments passed on to the converter as they are
+    int num_extra;
+} e2e_options;
+
+#ifndef _WIN32
+// writes the BMPs of the sequence into dir, returning their total size
+static size_t write_sequence(const e2e_options *o, const char *dir) {
+    size_t px_size = o->bpp/8;
+    size_t row_size = o->bpp == 24 ? ((size_t) o->width)*3 + PAD_24BPP(o->width) : ((size_t) o->width)*4;
+    size_t path_len = strlen_c(dir) + 32;
+    unsigned char *row = calloc(row_size, 1); // zeroed, so the padding is
+    char *path = malloc(path_len);
+    if (!row || !path) {
+        fprintf(stderr, "Memory allocation error when generating the BMPs.\n");
+        abort();
+    }
+    bmp_header header = {{'B', 'M'}, (unsigned int) (PIX_OFFSET + row_size*o->height), 0, 0, PIX_OFFSET};
+    bmp_info_header info = {40, o->width, o->height, 1, (unsigned short) o->bpp, 0, (unsigned int) (row_size*o->height),
+                            2835, 2835, 0, 0};
+    for (unsigned int f = 0; f < o->frames; ++f) {
+        snprintf(path, path_len, "%s/frame_%05u.bmp", dir, f);
+        FILE *fp = fopen(path, "wb");
+        if (!fp) {
+            fprintf(stderr, "Could not create \"%s\".\n", path);
+            perror("Error");
+            abort();
+        }
+        fwrite(&header, sizeof(header), 1, fp);
+        fwrite(&info, sizeof(info), 1, fp);
+        unsigned long long flat = next_rand(); // the frame's colour, if not noise
+        for (unsigned int y = 0; y < o->height; ++y) {
+            for (size_t x = 0; x < ((size_t) o->width)*px_size; ++x)
+                *(row + x) = (unsigned char) (o->noise ? next_rand() : flat >> 8*(x % px_size));
+            if (fwrite(row, sizeof(unsigned char), row_size, fp) != row_size) {
+                fprintf(stderr, "Error writing \"%s\" - is there enough space in \"%s\"?\n", path, o->dir);
+                abort();
+            }
+        }
+        if (fclose(fp)) {
+            fprintf(stderr, "Error writing \"%s\".\n", path);
+            abort();
+        }
+    }
+    free_ptrs(2, row, path);
+    return (PIX_OFFSET + row_size*o->height)*o->frames;
+}
+
+// starts the converter on dir with the arguments flags, then those passed on to it, writing the video to out_path
+static pid_t start_converter(const e2e_options *o, const char *dir, char *const *flags, int num_flags,
+                             const char *out_path) {
+    char **args = malloc((5 + num_flags + o->num_extra)*sizeof(char *));
+    if (!args) {
+        fprintf(stderr, "Memory allocation error when starting the converter.\n");
+        abort();
+    }
+    int n = 0;
+    *(args + n++) = (char *) o->converter;
+    *(args + n++) = (char *) dir;
+    for (int i = 0; i < num_flags; ++i)
+        *(args + n++) = *(flags + i);
+    *(args + n++) = "-o";
+    *(args + n++) = (char *) out_path;
+    for (int i = 0; i < o->num_extra; ++i)
+        *(args + n++) = *(o->extra + i);
+    *(args + n) = NULL;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("Error starting the converter");
+        abort();
+    }
+    if (!pid) { // its messages would get in the way of the results
+        if (!freopen("/dev/null", "w", stdout) || !freopen("/dev/null", "w", stderr))
+            _exit(126);
+        execvp(o->converter, args);
+        _exit(127);
+    }
+    free(args);
+    return pid;
+}
+
+// waits for the converter to exit, returning its exit status (128 + the signal if it was killed)
+static int wait_converter(pid_t pid, struct rusage *usage) {
+    int status;
+    while (wait4(pid, &status, 0, usage) == -1)
+        if (errno != EINTR) {
+            perror("Error waiting for the converter");
+            abort();
+        }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+// runs the converter once, returning its exit status (128 + the signal if it was killed)
+static int run_converter(const e2e_options *o, const char *dir, const char *sub, const char *out_path,
+                         unsigned long long *ns, long *max_rss_kb) {
+    char *flags[1] = {(char *) sub};
+    struct rusage usage;
+    unsigned long long start = get_time_ns();
+    int status = wait_converter(start_converter(o, dir, flags, 1, out_path), &usage);
+    *ns = get_time_ns() - start;
+    *max_rss_kb = usage.ru_maxrss; // in KiB on Linux
+    return status;
+}
+
+// returns the number of bytes of the video at path after its header (SIZE_MAX if it can't be read) - fp is left there
+static size_t open_frames(const char *path, FILE **fp) {
+    struct stat buff;
+    *fp = stat(path, &buff) == 0 ? fopen(path, "rb") : NULL;
+    if (!*fp)
+        return SIZE_MAX;
+    size_t header = 0;
+    int c;
+    while ((c = fgetc(*fp)) != EOF && ++header && c != '\n');
+    return c == EOF ? SIZE_MAX : (size_t) buff.st_size - header;
+}
+
+// whether the videos at path_a & path_b have the same frames - their headers differ in their X comments anyway
+static bool same_frames(const char *path_a, const char *path_b, size_t *bytes_a, size_t *bytes_b) {
+    FILE *a;
+    FILE *b;
+    *bytes_a = open_frames(path_a, &a);
+    *bytes_b = open_frames(path_b, &b);
+    bool same = a && b && *bytes_a == *bytes_b && *bytes_a != SIZE_MAX;
+    int c;
+    while (same && (c = fgetc(a)) != EOF)
+        same = fgetc(b) == c;
+    if (a)
+        fclose(a);
+    if (b)
+        fclose(b);
+    return same;
+}
+
+// removes dir, & the BMPs, videos & resume records in it
+static void remove_bench_dir(const e2e_options *o, const char *dir) {
+    static const char *const leftovers[] = {"bench.y4m", "bench.y4m.ckpt", "bench.y4m.ckpt.tmp", "bench.y4m.del",
+                                            "bench.y4m.del.tmp", "ref.y4m"};
+    size_t len = strlen_c(dir) + 32;
+    char *path = malloc(len);
+    if (!path) {
+        fprintf(stderr, "Memory allocation error when cleaning up \"%s\".\n", dir);
+        abort();
+    }
+    for (unsigned int f = 0; f < o->frames; ++f) {
+        snprintf(path, len, "%s/frame_%05u.bmp", dir, f);
+        remove(path);
+    }
+    for (size_t i = 0; i < sizeof(leftovers)/sizeof(*leftovers); ++i) {
+        snprintf(path, len, "%s/%s", dir, leftovers[i]);
+        remove(path);
+    }
+    free(path);
+    rmdir(dir);
+}
+#endif
+
+/* generates a sequence of BMPs in a temporary directory, then converts it with every sub-sampling, reporting the
+ * fastest run's throughput & the highest peak memory use of the converter across runs */
+static void bench_e2e(const e2e_options *o) {
+#ifdef _WIN32
+    fprintf(stderr, "The end-to-end benchmark is only supported on POSIX systems.\n");
+    abort();
+#else
+    static const char *const sub_args[] = {"-sub=444", "-sub=422", "-sub=420", "-sub=411", "-sub=410"};
+    struct stat buff;
+    const char *base = o->dir ? o->dir : (stat(E2E_DIR, &buff) == 0 && S_ISDIR(buff.st_mode) ? E2E_DIR :
+                                          E2E_FALLBACK_DIR);
+    size_t len = strlen_c(base) + 48;
+    char *dir = malloc(len);
+    char *out_path = malloc(len);
+    if (!dir || !out_path) {
+        fprintf(stderr, "Memory allocation error when setting up the benchmark.\n");
+        abort();
+    }
+    snprintf(dir, len, "%s/y4m_bench_%ld", base, (long) getpid());
+    snprintf(out_path, len, "%s/bench.y4m", dir); // the scan only picks up BMPs, so it can go with them
+    if (mkdir(dir, 0700)) {
+        fprintf(stderr, "Could not create directory \"%s\".\n", dir);
+        perror("Error");
+        abort();
+    }
+    size_t bytes_in = write_sequence(o, dir);
+    for (int s = 0; s < 5; ++s) {
+        unsigned long long best_ns = 0;
+        unsigned long long ns;
+        long max_rss_kb = 0;
+        long rss_kb;
+        int status = 0;
+        for (unsigned int run = 0; run < o->runs && !status; ++run) {
+            status = run_converter(o, dir, sub_args[s], out_path, &ns, &rss_kb);
+            if (!best_ns || ns < best_ns)
+                best_ns = ns;
+            if (rss_kb > max_rss_kb)
+                max_rss_kb = rss_kb;
+        }
+        size_t bytes_out = stat(out_path, &buff) == 0 ? (size_t) buff.st_size : 0;
+        remove(out_path);
+        if (status)
+            fprintf(stderr, "The converter exited with status %d for \"%s\".\n", status, sub_args[s]);
+        double secs = best_ns/1e9;
+        printf("{\"bench\": \"e2e\", \"sub\": \"%s\", \"width\": %u, \"height\": %u, \"frames\": %u, \"bpp\": %u, "
+               "\"content\": \"%s\", \"exit\": %d, \"s\": %.4f, \"fps\": %.2f, \"mb_in_per_s\": %.1f, "
+               "\"mb_out_per_s\": %.1f, \"peak_rss_kb\": %ld}\n", subs[s], o->width, o->height, o->frames, o->bpp,
+               o->noise ? "noise" : "flat", status, secs, o->frames/secs, bytes_in/secs/1e6, bytes_out/secs/1e6,
+               max_rss_kb);
+        fflush(stdout);
+    }
+    remove_bench_dir(o, dir);
+    free_ptrs(2, dir, out_path);
+#endif
+}
+
+/* converts a generated sequence with "-d -resume", kills the converter once about a third of the frames are in the
+ * video - when the BMPs of the last of them are usually yet to be deleted - then resumes the conversion, checking that
+ * the video ends up with the same frames as one converted in one go, & that every BMP is deleted. Returns false if
+ * it doesn't, or if the converter finished before it could be killed */
+static bool bench_resume(const e2e_options *o) {
+#ifdef _WIN32
+    fprintf(stderr, "The resume test is only supported on POSIX systems.\n");
+    abort();
+#else
+    static char *const first_flags[] = {"-sub=420", "-d", "-resume", "-sync=4"};
+    static char *const resume_flags[] = {"-sub=420", "-d", "-resume"};
+    struct stat buff;
+    const char *base = o->dir ? o->dir : (stat(E2E_DIR, &buff) == 0 && S_ISDIR(buff.st_mode) ? E2E_DIR :
+                                          E2E_FALLBACK_DIR);
+    size_t len = strlen_c(base) + 48;
+    char *dir = malloc(len);
+    char *out_path = malloc(len);
+    char *ref_path = malloc(len);
+    if (!dir || !out_path || !ref_path) {
+        fprintf(stderr, "Memory allocation error when setting up the resume test.\n");
+        abort();
+    }
+    snprintf(dir, len, "%s/y4m_resume_%ld", base, (long) getpid());
+    snprintf(out_path, len, "%s/bench.y4m", dir);
+    snprintf(ref_path, len, "%s/ref.y4m", dir);
+    if (mkdir(dir, 0700)) {
+        fprintf(stderr, "Could not create directory \"%s\".\n", dir);
+        perror("Error");
+        abort();
+    }
+    write_sequence(o, dir);
+    struct rusage usage;
+    int status = wait_converter(start_converter(o, dir, first_flags, 1, ref_path), &usage); // only "-sub", in one go
+    size_t ref_bytes = stat(ref_path, &buff) == 0 ? (size_t) buff.st_size : 0;
+    int killed_status = 0;
+    bool killed = false;
+    if (!status) {
+        pid_t pid = start_converter(o, dir, first_flags, 4, out_path);
+        int wstatus;
+        pid_t done;
+        while (!(done = waitpid(pid, &wstatus, WNOHANG)) &&
+               (stat(out_path, &buff) || (size_t) buff.st_size < ref_bytes/3))
+            nanosleep(&(struct timespec) {0, 1000000}, NULL);
+        if (!done) {
+            kill(pid, SIGKILL);
+            killed = true;
+            killed_status = wait_converter(pid, &usage);
+        }
+        status = wait_converter(start_converter(o, dir, resume_flags, 3, out_path), &usage);
+    }
+    size_t bytes_out;
+    size_t ref_frames_bytes;
+    bool same = same_frames(out_path, ref_path, &bytes_out, &ref_frames_bytes);
+    unsigned int bmps_left = 0;
+    size_t path_len = strlen_c(dir) + 32;
+    char *path = malloc(path_len);
+    for (unsigned int f = 0; path && f < o->frames; ++f) {
+        snprintf(path, path_len, "%s/frame_%05u.bmp", dir, f);
+        bmps_left += stat(path, &buff) == 0;
+    }
+    free(path);
+    size_t rec = o->frames && ref_frames_bytes != SIZE_MAX ? ref_frames_bytes/o->frames : 0; // "FRAME" + planes
+    bool pass = !status && killed && killed_status == 128 + SIGKILL && same && !bmps_left;
+    printf("{\"bench\": \"resume\", \"width\": %u, \"height\": %u, \"frames\": %u, \"killed\": %s, \"exit\": %d, "
+           "\"frames_out\": %zu, \"same_frames\": %s, \"bmps_left\": %u, \"pass\": %s}\n", o->width, o->height,
+           o->frames, killed ? "true" : "false", status, rec && bytes_out != SIZE_MAX ? bytes_out/rec : 0,
+           same ? "true" : "false", bmps_left, pass ? "true" : "false");
+    fflush(stdout);
+    if (!killed)
+        fprintf(stderr, "The converter finished before it could be killed - try more or larger frames.\n");
+    remove_bench_dir(o, dir);
+    free_ptrs(3, dir, out_path, ref_path);
+    return pass;
+#endif
+}
+
+// parses the arguments of "bench e2e" - returns false if they're invalid
+static bool parse_e2e(int argc, char **argv, e2e_options *o) {
+    o->converter = NULL;
+    o->width = 1920;
+    o->height = 1080;
+    o->frames = 60;
+    o->bpp = 24;
+    o->noise = true;
+    o->runs = 3;
+    o->dir = NULL;
+    o->extra = NULL;
+    o->num_extra = 0;
+    const char *end;
+    for (int i = 0; i < argc; ++i) {
+        const char *arg = *(argv + i);
+        if (equal(arg, "--")) { // the rest go to the converter
+            o->extra = argv + i + 1;
+            o->num_extra = argc - i - 1;
+            break;
+        }
+        if (startswith(arg, "-size=")) {
+            long long w = to_ll(arg + 6, &end);
+            if (*end != 'x')
+                return false;
+            long long h = to_ll(end + 1, &end);
+            if (*end || w < 4 || h < 2 || w > 65536 || h > 65536)
+                return false;
+            o->width = (unsigned int) w;
+            o->height = (unsigned int) h;
+        }
+        else if (startswith(arg, "-frames="))
+            o->frames = parse_count(arg, 8);
+        else if (startswith(arg, "-runs="))
+            o->runs = parse_count(arg, 6);
+        else if (equal(arg, "-bpp=24") || equal(arg, "-bpp=32"))
+            o->bpp = *(arg + 5) == '2' ? 24 : 32;
+        else if (equal(arg, "-content=noise") || equal(arg, "-content=flat"))
+            o->noise = *(arg + 9) == 'n';
+        else if (startswith(arg, "-dir=") && *(arg + 5))
+            o->dir = arg + 5;
+        else if (!o->converter && !startswith_c(arg, '-'))
+            o->converter = arg;
+        else
+            return false;
+    }
+    return o->converter != NULL;
+}
+
+static void print_usage(void) {
+    fprintf(stderr, "Usage: bench <benchmark> [args]\n"
+                    "Benchmarks:\n"
+                    "\tsort [entries...]\tsorts shuffled frame paths (default: 10000 100000 1000000 entries)\n"
+                    "\tconv [width height]\tconverts a frame with every backend (default: 1920 1080)\n"
+                    "\tcheck [width height]\tchecks every backend against the reference kernels, failing if any "
+                    "sample is off by more than %d (default: 643 361)\n"
+                    "\te2e <converter> [-size=<w>x<h>] [-frames=<num>] [-bpp=24|32] [-content=noise|flat] "
+                    "[-runs=<num>] [-dir=<path>] [-- <converter args>]\n"
+                    "\t\t\t\tconverts a generated sequence (default: 60 1920x1080 24 bpp noise frames in "
+                    E2E_DIR ") with every sub-sampling, reporting the fastest of 3 runs\n"
+                    "\tresume <converter> [e2e args]\tkills a \"-d -resume\" conversion of a generated sequence a "
+                    "third of the way through & resumes it, failing unless the video & the BMPs deleted match a "
+                    "conversion in one go\n", CHECK_TOLERANCE);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        print_usage();
+        return 1;
+    }
+    if (equal(*(argv + 1), "sort")) {
+        static const size_t defaults[] = {10000, 100000, 1000000};
+        size_t count;
+        for (int i = 0; i < (argc > 2 ? argc - 2 : 3); ++i) {
+            if (argc > 2) {
+                if (!is_numeric(*(argv + 2 + i), false) || !(count = (size_t) to_ll(*(argv + 2 + i), NULL))) {
+                    fprintf(stderr, "Invalid number of entries: \"%s\"\n", *(argv + 2 + i));
+                    return 1;
+                }
+            }
+            else
+                count = defaults[i];
+            bench_sort(count, false);
+            bench_sort(count, true);
+        }
+        return 0;
+    }
+    if (equal(*(argv + 1), "conv")) {
+        long long dims[2] = {1920, 1080};
+        if (argc == 4) {
+            for (int i = 0; i < 2; ++i) {
+                if (!is_numeric(*(argv + 2 + i), false) || (dims[i] = to_ll(*(argv + 2 + i), NULL)) < 4 ||
+                    dims[i] > 65536) {
+                    fprintf(stderr, "Invalid frame dimension: \"%s\"\n", *(argv + 2 + i));
+                    return 1;
+                }
+            }
+        }
+        else if (argc != 2) {
+            print_usage();
+            return 1;
+        }
+        bench_conv((unsigned int) dims[0], (unsigned int) dims[1]);
+        return 0;
+    }
+    if (equal(*(argv + 1), "check")) {
+        long long dims[2] = {643, 361}; // odd, so the trimming & the padding of the rows are checked as well
+        if (argc == 4) {
+            for (int i = 0; i < 2; ++i) {
+                if (!is_numeric(*(argv + 2 + i), false) || (dims[i] = to_ll(*(argv + 2 + i), NULL)) < 4 ||
+                    dims[i] > 65536) {
+                    fprintf(stderr, "Invalid frame dimension: \"%s\"\n", *(argv + 2 + i));
+                    return 1;
+                }
+            }
+        }
+        else if (argc != 2) {
+            print_usage();
+            return 1;
+        }
+        return bench_check((unsigned int) dims[0], (unsigned int) dims[1]) ? 0 : 1;
+    }
+    if (equal(*(argv + 1), "e2e")) {
+        e2e_options o;
+        if (!parse_e2e(argc - 2, argv + 2, &o)) {
+            print_usage();
+            return 1;
+        }
+        bench_e2e(&o);
+        return 0;
+    }
+    if (equal(*(argv + 1), "resume")) {
+        e2e_options o;
+        if (!parse_e2e(argc - 2, argv + 2, &o)) {
+            print_usage();
+            return 1;
+        }
+        return bench_resume(&o) ? 0 : 1;
+    }
+    print_usage();
+    return 1;
+}
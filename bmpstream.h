@@ -0,0 +1,113 @@
+//
+// reading BMPs one after another from a single stream (a pipe, FIFO or file), with no intermediate files
+//
+
+#pragma once
+
+#include "overhead.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+/* BMPs in the stream are simply concatenated, each one's length being the fileSize field of its header. As pipes can't
+ * be seeked in, a BMP is read in whole into a buffer before it is converted, its bottom-up rows then being walked from
+ * there like those of a mapped file. The headers of the next BMP are read ahead of the rest of it, so that the
+ * dimensions of the video can be taken from the first BMP before any of the stream has been converted. */
+typedef struct {
+    FILE *fp;
+    const char *name; // how the stream is referred to in error messages
+    unsigned char headers[sizeof(bmp_header) + sizeof(bmp_info_header)]; // of the next BMP, if have_headers
+    bool have_headers;
+} bmp_stream;
+
+/* reads size bytes of the stream into buf, carrying on after a read is interrupted by a signal - unless it's SIGINT,
+ * which stops the conversion. Returns the number of bytes read, which is only short in that case, at the end of the
+ * stream, or on an error */
+static size_t read_fully(bmp_stream *in, unsigned char *buf, size_t size) {
+    size_t num_read = 0;
+    for (;;) {
+        num_read += fread(buf + num_read, sizeof(unsigned char), size - num_read, in->fp);
+        if (num_read == size || !ferror(in->fp) || errno != EINTR || stop_requested)
+            return num_read;
+        clearerr(in->fp);
+    }
+}
+
+static bool read_stream_headers(bmp_stream *in) { // returns false if the stream has ended, or on SIGINT
+    if (stop_requested) // the stream may never have anything more to read
+        return false;
+    size_t num_read = read_fully(in, in->headers, sizeof(in->headers));
+    if ((num_read == 0 && feof(in->fp)) || stop_requested)
+        return false;
+    if (num_read != sizeof(in->headers)) {
+        fprintf(stderr, "Input stream \"%s\" ended part-way through the headers of a BMP.\n", in->name);
+        abort();
+    }
+    if (*in->headers != 'B' || *(in->headers + 1) != 'M') { // most likely a fileSize that was wrong
+        fprintf(stderr, "Input stream \"%s\" does not continue with a BMP where one was expected.\n", in->name);
+        abort();
+    }
+    in->have_headers = true;
+    return true;
+}
+
+/* opens the stream at path ("-" for stdin) & reads the headers of its first BMP, which in->have_headers is left false
+ * for if there are none. Returns false if the stream can't be opened */
+bool open_bmp_stream(bmp_stream *in, const char *path) {
+    in->have_headers = false;
+    if (equal(path, "-")) {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        in->fp = stdin;
+        in->name = "standard input";
+    }
+    else {
+        in->fp = fopen(path, "rb"); // works just as well for FIFOs, blocking until the writer opens its end
+        in->name = path;
+        if (!in->fp)
+            return false;
+    }
+    read_stream_headers(in);
+    return true;
+}
+
+void close_bmp_stream(bmp_stream *in) {
+    if (in->fp != stdin)
+        fclose(in->fp);
+    in->fp = NULL;
+}
+
+/* reads the next BMP of the stream into *buf, growing it (& *buf_size with it) if it's too small, & returns the BMP's
+ * size - or 0 once the stream has ended, or on SIGINT (a BMP read in part is then dropped) */
+size_t read_stream_bmp(bmp_stream *in, unsigned char **buf, size_t *buf_size) {
+    if (!in->have_headers && !read_stream_headers(in))
+        return 0;
+    in->have_headers = false;
+    size_t file_size = ((const bmp_header *) in->headers)->fileSize;
+    if (file_size < sizeof(in->headers)) {
+        fprintf(stderr, "BMP in input stream \"%s\" has an invalid file size: %zu bytes\n", in->name, file_size);
+        abort();
+    }
+    if (file_size > *buf_size) {
+        free(*buf);
+        *buf = malloc(file_size); // no need to realloc(), as nothing in the buffer is kept
+        if (!*buf) {
+            fprintf(stderr, "Memory allocation error when reading from input stream \"%s\".\n", in->name);
+            abort();
+        }
+        *buf_size = file_size;
+    }
+    for (size_t i = 0; i < sizeof(in->headers); ++i)
+        *(*buf + i) = *(in->headers + i);
+    size_t rest = file_size - sizeof(in->headers);
+    if (read_fully(in, *buf + sizeof(in->headers), rest) != rest) {
+        if (stop_requested)
+            return 0;
+        fprintf(stderr, "Input stream \"%s\" ended part-way through a BMP.\n", in->name);
+        abort();
+    }
+    return file_size;
+}
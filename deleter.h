@@ -0,0 +1,166 @@
+//
+// deleting the BMPs in the background once their frames have been written ("-d")
+//
+
+#pragma once
+
+#include "trace.h"
+#include "resume.h"
+
+#ifdef _WIN32
+#include <io.h> // _commit()
+#endif
+
+#define DEL_QUEUE_SIZE 256 // max. number of BMPs waiting to be deleted, before the writer has to wait for the deleter
+
+/* Deleting a file can take milliseconds on a network or journalled filesystem, so the writer only ever hands each BMP
+ * over to a thread of its own, through a bounded queue. A BMP is only handed over once its frame has been written,
+ * & flushed out of any stdio buffer - so no BMP is ever deleted if the conversion fails before its frame is in the
+ * video. With "-sync=<n>", the BMPs of the frames written are held back until the video has been fdatasync()ed, which
+ * is done every n frames, so they're only deleted once their frames are on disk for good. The deletions still queued
+ * when the conversion stops (on SIGINT or at the end) are finished before exiting, but not if it's aborted - so with
+ * "-resume", each deletion is recorded before it's done, for the BMPs still there to be matched up with the frames
+ * already in the video (see resume.h). */
+typedef struct {
+    FILE *fp; // the video, when written through stdio (NULL otherwise)
+    int fd; // the video's file descriptor otherwise
+    unsigned int sync_every; // number of frames between fdatasync()s (0 -> none)
+    checkpoint *ckpt; // where the deletions are recorded
+    char **pending; // paths of the BMPs of the frames written since the last sync
+    size_t num_pending;
+    char *queue[DEL_QUEUE_SIZE]; // paths handed over to the deleter, from head onwards
+    size_t head;
+    size_t count;
+    bool done; // whether the writer has finished handing over paths
+    mutex_t lock;
+    cond_t queued;
+    cond_t dequeued;
+    thread_t thread;
+} deleter;
+
+/* space (in bytes) that the next num_frames frames of a video, of record bytes each, need on its filesystem when the
+ * BMPs deleted, of bmp_bytes each, are on the same one: the space each BMP takes up is only reclaimed once its frame
+ * has been synced & its turn in the queue has come, so the video can be up to a sync window & a full queue of frames
+ * ahead of the deletions */
+size_t space_needed(size_t num_frames, size_t record, size_t bmp_bytes, unsigned int sync_every) {
+    size_t lag = (sync_every ? sync_every : 1) + DEL_QUEUE_SIZE + 2; // + the one being deleted & the one being written
+    size_t peak = (num_frames < lag ? num_frames : lag)*record; // before any space is reclaimed
+    if (num_frames > lag && record > bmp_bytes) // the video outgrows the space reclaimed, so peaks at its end
+        peak += (num_frames - lag)*(record - bmp_bytes);
+    return peak;
+}
+
+// records the deletion of the BMP at path for "-resume" (see resume.h), then deletes it
+void delete_bmp(checkpoint *ckpt, const char *path) {
+    if (!record_deletion(ckpt, path)) {
+        fprintf(stderr, "Error recording the deletion of file \"%s\" - it's kept.\n", path);
+        perror("Error type");
+        abort();
+    }
+    if (remove(path)) {
+        fprintf(stderr, "Error occurred when trying to delete file \"%s\".\n", path);
+        abort();
+    }
+}
+
+static void deleter_thread(void *arg) {
+    deleter *d = arg;
+    char *path;
+    unsigned long long beg_ns;
+    trace_thread_name("deleter");
+    mutex_lock(&d->lock);
+    for (;;) {
+        while (!d->count && !d->done)
+            cond_wait(&d->queued, &d->lock);
+        if (!d->count)
+            break;
+        path = *(d->queue + d->head);
+        d->head = (d->head + 1) % DEL_QUEUE_SIZE;
+        --d->count;
+        cond_broadcast(&d->dequeued);
+        mutex_unlock(&d->lock);
+        beg_ns = trace_begin();
+        delete_bmp(d->ckpt, path);
+        trace_end("remove", TRACE_NO_FRAME, beg_ns);
+        free(path);
+        mutex_lock(&d->lock);
+    }
+    mutex_unlock(&d->lock);
+}
+
+// starts the deleter for a video written to fp (or to fd, if fp is NULL), the checkpoints of which are ckpt
+void start_deleter(deleter *d, FILE *fp, int fd, unsigned int sync_every, checkpoint *ckpt) {
+    d->fp = fp;
+    d->fd = fd;
+    d->sync_every = sync_every;
+    d->ckpt = ckpt;
+    d->pending = malloc((sync_every ? sync_every : 1)*sizeof(char *));
+    if (!d->pending) {
+        fprintf(stderr, "Memory allocation error when setting up the deletion of the BMPs.\n");
+        abort();
+    }
+    d->num_pending = 0;
+    d->head = 0;
+    d->count = 0;
+    d->done = false;
+    mutex_init(&d->lock);
+    cond_init(&d->queued);
+    cond_init(&d->dequeued);
+    thread_create(&d->thread, deleter_thread, d);
+}
+
+static void release_pending(deleter *d) { // makes sure the frames written are in the video, then queues their BMPs
+    if (!d->num_pending)
+        return;
+    if (d->fp && fflush(d->fp)) {
+        fprintf(stderr, "Error writing the video - the BMPs of the frames not written are kept.\n");
+        perror("Error type");
+        abort();
+    }
+    int fd = d->fp ? fileno(d->fp) : d->fd;
+#ifdef _WIN32
+    if (d->sync_every && _commit(fd) && errno != EBADF) {
+#else
+    if (d->sync_every && fdatasync(fd) && errno != EINVAL && errno != EROFS) { // pipes can't be synced
+#endif
+        fprintf(stderr, "Error syncing the video to disk - the BMPs of the frames not synced are kept.\n");
+        perror("Error type");
+        abort();
+    }
+    mutex_lock(&d->lock);
+    for (size_t i = 0; i < d->num_pending; ++i) {
+        while (d->count == DEL_QUEUE_SIZE)
+            cond_wait(&d->dequeued, &d->lock);
+        *(d->queue + (d->head + d->count++) % DEL_QUEUE_SIZE) = *(d->pending + i);
+    }
+    cond_broadcast(&d->queued);
+    mutex_unlock(&d->lock);
+    d->num_pending = 0;
+}
+
+// has the BMP at path deleted, once its frame (which has just been written) is safely in the video - see above
+void delete_when_written(deleter *d, const char *path) {
+    char *copy = malloc(strlen_c(path) + 1);
+    if (!copy) {
+        fprintf(stderr, "Memory allocation error when deleting \"%s\".\n", path);
+        abort();
+    }
+    strcpy_c(copy, path);
+    *(d->pending + d->num_pending++) = copy;
+    if (d->num_pending == (d->sync_every ? d->sync_every : 1))
+        release_pending(d);
+}
+
+// deletes the BMPs of all the frames written so far, & waits for the deleter to finish
+void stop_deleter(deleter *d) {
+    release_pending(d);
+    mutex_lock(&d->lock);
+    d->done = true;
+    cond_broadcast(&d->queued);
+    mutex_unlock(&d->lock);
+    thread_join(d->thread);
+    cond_destroy(&d->dequeued);
+    cond_destroy(&d->queued);
+    mutex_destroy(&d->lock);
+    free(d->pending);
+}
@@ -0,0 +1,83 @@
+//
+// read-only memory mapping of whole files (mmap() on POSIX systems, file mapping objects when on Win.)
+//
+
+#pragma once
+
+#include "overhead.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
+
+typedef struct {
+    const unsigned char *data; // NULL for empty files, which can't be mapped
+    size_t size;
+} file_map;
+
+bool map_file(file_map *map, const char *path) { // returns false if the file can't be opened or mapped
+    map->data = NULL;
+    map->size = 0;
+#ifdef _WIN32
+    // FILE_SHARE_DELETE, so that "-d" can delete a BMP while it's still mapped (it goes once it is unmapped)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return false;
+    }
+    if (size.QuadPart == 0) {
+        CloseHandle(file);
+        return true;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file); // the mapping object keeps its own reference to the file
+    if (mapping == NULL)
+        return false;
+    map->data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping); // as does the view to the mapping object
+    if (map->data == NULL)
+        return false;
+    map->size = (size_t) size.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat buff;
+    if (fstat(fd, &buff) == -1) {
+        close(fd);
+        return false;
+    }
+    if (buff.st_size == 0) {
+        close(fd);
+        return true;
+    }
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE; // fault all the pages in now, so the reader threads do the I/O rather than the converters
+#endif
+    void *data = mmap(NULL, (size_t) buff.st_size, PROT_READ, flags, fd, 0);
+    close(fd); // the mapping stays valid after the descriptor is closed
+    if (data == MAP_FAILED)
+        return false;
+    map->data = data;
+    map->size = (size_t) buff.st_size;
+#endif
+    return true;
+}
+
+void unmap_file(file_map *map) {
+    if (map->data) {
+#ifdef _WIN32
+        UnmapViewOfFile(map->data);
+#else
+        munmap((void *) map->data, map->size);
+#endif
+    }
+    map->data = NULL;
+    map->size = 0;
+}
@@ -0,0 +1,157 @@
+//
+// table-driven versions of the colour sub-sampling kernels in overhead.h
+//
+
+#pragma once
+
+#include "overhead.h"
+
+/* Each Y, Cb & Cr value is the sum of one term per channel, each of which is looked up in a table of 256 entries
+ * rather than multiplied out - the tables hold the fixed-point coefficients times every channel value, with the
+ * rounding constant & the chroma offset folded into them, so a value costs 3 lookups, 2 additions & a single shift,
+ * and the results are exactly those of the fixed-point kernels. Cb & Cr share their tables: each 64-bit entry holds
+ * the Cb term in its low half & the Cr term in its high half, both biased so as never to be negative, so a single
+ * addition sums both, & the sums of up to 8 colours for the sub-sampled chroma never carry from one half into the
+ * other. All 9 tables take up 9 KiB, so they stay in the L1 cache. They are filled in by init_lut(), once at startup,
+ * before any kernel runs. */
+
+static unsigned int lut_y[3][256]; // R, G & B terms of Y
+static unsigned long long lut_cbcr[3][256]; // R, G & B terms of Cb (low 32 bits) & Cr (high 32 bits)
+
+static inline unsigned int lut_entry(int coef, int val) { // biased by the most negative value the term can take
+    return (unsigned int) (coef*val - (coef < 0 ? coef*255 : 0));
+}
+
+void init_lut(void) {
+    static const int cb_coefs[3] = {FX_CB_R, FX_CB_G, FX_CB_B};
+    static const int cr_coefs[3] = {FX_CR_R, FX_CR_G, FX_CR_B};
+    long long cb_bias = FX_OFFSET + FX_HALF; // what's left of the constant terms once the biases are taken out
+    long long cr_bias = FX_OFFSET + FX_HALF;
+    for (int ch = 0; ch < 3; ++ch) {
+        cb_bias += *(cb_coefs + ch) < 0 ? *(cb_coefs + ch)*255 : 0;
+        cr_bias += *(cr_coefs + ch) < 0 ? *(cr_coefs + ch)*255 : 0;
+    }
+    for (int val = 0; val < 256; ++val) {
+        lut_y[0][val] = FX_Y_R*val + FX_HALF;
+        lut_y[1][val] = FX_Y_G*val;
+        lut_y[2][val] = FX_Y_B*val;
+        for (int ch = 0; ch < 3; ++ch) // the remaining constant goes into the R terms (it's positive for both)
+            lut_cbcr[ch][val] = (unsigned long long) (lut_entry(*(cb_coefs + ch), val) + (ch ? 0 : cb_bias)) |
+                                (unsigned long long) (lut_entry(*(cr_coefs + ch), val) + (ch ? 0 : cr_bias)) << 32;
+    }
+}
+
+static inline unsigned char get_Y_lut(const colour *col) {
+    return (unsigned char) ((lut_y[0][col->r] + lut_y[1][col->g] + lut_y[2][col->b]) >> FX_SHIFT);
+}
+
+static inline unsigned long long get_CbCr_lut(const colour *col) { // un-shifted, for summing over several colours
+    return lut_cbcr[0][col->r] + lut_cbcr[1][col->g] + lut_cbcr[2][col->b];
+}
+
+// Cb & Cr of the average of 2^k colours, given the sum of their get_CbCr_lut() values
+static inline void put_CbCr_lut(unsigned char *cb, unsigned char *cr, unsigned long long sum, int k) {
+    int v = (int) ((sum & 0xffffffffull) >> (FX_SHIFT + k));
+    *cb = FX_CLAMP(v);
+    v = (int) ((sum >> 32) >> (FX_SHIFT + k));
+    *cr = FX_CLAMP(v);
+}
+
+void output_444_lut(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                    unsigned char *cr, unsigned int width, unsigned int height) {
+    const colour *ptr;
+    unsigned int j;
+    unsigned int i;
+    for (j = 0; j < height; ++j, input = next_row(input, stride)) {
+        ptr = input;
+        for (i = 0; i < width; ++i, ++ptr) {
+            *luma++ = get_Y_lut(ptr);
+            put_CbCr_lut(cb++, cr++, get_CbCr_lut(ptr), 0);
+        }
+    }
+}
+
+void output_422_lut(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                    unsigned char *cr, unsigned int width, unsigned int height) {
+    const colour *ptr;
+    unsigned int j;
+    unsigned int i;
+    for (j = 0; j < height; ++j, input = next_row(input, stride)) {
+        ptr = input;
+        for (i = 0; i < width; i += 2, ptr += 2) { // width is guaranteed to be even
+            *luma++ = get_Y_lut(ptr);
+            *luma++ = get_Y_lut(ptr + 1);
+            put_CbCr_lut(cb++, cr++, get_CbCr_lut(ptr) + get_CbCr_lut(ptr + 1), 1);
+        }
+    }
+}
+
+void output_420_lut(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                    unsigned char *cr, unsigned int width, unsigned int height) {
+    const colour *ptr;
+    const colour *nxt;
+    unsigned char *y2;
+    unsigned int j;
+    unsigned int i;
+    for (j = 0; j < height; j += 2, input = next_row(input, 2*stride), luma = y2) { // width & height are both even
+        ptr = input;
+        nxt = next_row(input, stride);
+        y2 = luma + width;
+        for (i = 0; i < width; i += 2, ptr += 2, nxt += 2) { // one 2x2 block at a time
+            *luma++ = get_Y_lut(ptr);
+            *luma++ = get_Y_lut(ptr + 1);
+            *y2++ = get_Y_lut(nxt);
+            *y2++ = get_Y_lut(nxt + 1);
+            put_CbCr_lut(cb++, cr++, get_CbCr_lut(ptr) + get_CbCr_lut(ptr + 1) + get_CbCr_lut(nxt) +
+                                     get_CbCr_lut(nxt + 1), 2);
+        }
+    }
+}
+
+void output_411_lut(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                    unsigned char *cr, unsigned int width, unsigned int height) {
+    const colour *ptr;
+    unsigned int j;
+    unsigned int i;
+    unsigned int k;
+    unsigned long long sum;
+    for (j = 0; j < height; ++j, input = next_row(input, stride)) {
+        ptr = input;
+        for (i = 0; i < width; i += 4, ptr += 4) { // width is guaranteed to be divisible by 4
+            sum = 0;
+            for (k = 0; k < 4; ++k) {
+                *luma++ = get_Y_lut(ptr + k);
+                sum += get_CbCr_lut(ptr + k);
+            }
+            put_CbCr_lut(cb++, cr++, sum, 2);
+        }
+    }
+}
+
+void output_410_lut(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                    unsigned char *cr, unsigned int width, unsigned int height) {
+    const colour *ptr;
+    const colour *nxt;
+    unsigned char *y2;
+    unsigned int j;
+    unsigned int i;
+    unsigned int k;
+    unsigned long long sum;
+    for (j = 0; j < height; j += 2, input = next_row(input, 2*stride), luma = y2) { // height will be even
+        ptr = input;
+        nxt = next_row(input, stride);
+        y2 = luma + width;
+        for (i = 0; i < width; i += 4, ptr += 4, nxt += 4) { // one 4x2 block at a time (width is divisible by 4)
+            sum = 0;
+            for (k = 0; k < 4; ++k) {
+                *luma++ = get_Y_lut(ptr + k);
+                *y2++ = get_Y_lut(nxt + k);
+                sum += get_CbCr_lut(ptr + k) + get_CbCr_lut(nxt + k);
+            }
+            put_CbCr_lut(cb++, cr++, sum, 3);
+        }
+    }
+}
+
+static const conv_kernels lut_kernels = {output_444_lut, output_422_lut, output_420_lut, output_411_lut,
+                                         output_410_lut, diff_tiles};
@@ -2,22 +2,22 @@
 // created by Gregor Hartl Watters on 13/09/2022
 //
 
-#include "overhead.h"
+#include "stream.h"
+#include "scan.h"
+#include "bmpstream.h"
+#include "watch.h"
+#include "resume.h"
 
-#define MIN_ARR_SIZE 128 // starting size of array to store bmp paths
+#define DRY_RUN_SAMPLES 8 // number of frames "-dry-run" converts to estimate how long the whole video would take
 
 char *bmp_path = NULL; // global pointers, so they can be easily freed with a func. passed to atexit()
-char *path = NULL;
-const char **array = NULL;
+const char **array = NULL; // the BMP paths, stored along with the array (see scan_bmps())
 char *vid_path = NULL;
 const char *yuv_h = NULL;
-colour *colours = NULL;
-unsigned char *final_clrs = NULL;
+// the frame buffers are owned by the pipeline, & aren't freed here, as its threads could still be using them
 
 void clean(void) {
-    if (array)
-        free_array(array);
-    free_ptrs(6, bmp_path, path, vid_path, yuv_h, colours, final_clrs);
+    free_ptrs(4, bmp_path, array, vid_path, yuv_h);
 }
 
 _Noreturn void handler(int signal) {
@@ -29,21 +29,19 @@ _Noreturn void handler(int signal) {
 
 static inline void term_if_zero(size_t val);
 
+static int dry_run(pipeline *pl, bool stream, const char *vid_path, size_t header_len);
+
 int main(int argc, char **argv) {
     atexit(clean); // register clean func. with atexit() - ensures pointers are freed in case of premature termination
     signal(SIGABRT, handler);
-    time_t beg_time = time(NULL);
-    bool delete = false; // whether to delete .bmp images as they are appended to the video
-    bool timed = false; // whether to display the time taken for the video generation
-    bool give_size = false; // whether to display the total file size of the video generated
-    bool prog = false; // whether to show the progress of the video generation
-    char *vpath_given = NULL; // path to the .y4m as given by the user - remains NULL if none given
-    const char *folder_path = NULL; // path to directory containing .bmp files - if none given, cwd is used
-    long long rate_num = 30; // default frame rate numerator
-    long long rate_denom = 1; // default frame rate denominator
-    const char *cmpr = "420"; // default colour sub-sampling
-    process_argv(argc, argv, &delete, &timed, &give_size, &prog, &vpath_given, &folder_path, &rate_num,
-                 &rate_denom, &cmpr);
+    install_stop_handler(); // finishes the frame being written, so the video can be resumed
+    unsigned long long beg_ns = get_time_ns();
+    options opts; // see process_argv() for the defaults
+    process_argv(argc, argv, &opts);
+    FILE *msgs = opts.vid_path && equal(opts.vid_path, "-") ? stderr : stdout; // keeps them out of the video
+    const conv_kernels *kernels = get_kernels(opts.backend);
+    const char *folder_path = opts.folder_path;
+    const char *cmpr = opts.subsampling;
 #ifdef _WIN32
     DWORD fileAttr = GetFileAttributesA(folder_path);
     if (fileAttr == INVALID_FILE_ATTRIBUTES) {
@@ -72,96 +70,98 @@ int main(int argc, char **argv) {
         *(bmp_path + len++) = file_sep();
         *(bmp_path + len) = 0;
     }
-    size_t size = 0; // have to leave space for NULL at the end of the array
-#ifdef _WIN32
-    path = malloc(sizeof(char)*(len + 6));
-    strcpy_c(path, folder_path);
-    strcat_c(path, "*.bmp");
-    WIN32_FIND_DATAA find = {0};
-    HANDLE first = FindFirstFileA(path, &find);
-    free(path);
-    path = NULL;
-    if (first == INVALID_HANDLE_VALUE) {
-        fprintf(stderr, "No .bmp files found in specified directory.\n");
-        abort();
-    }
-#else
-    struct dirent *entry;
-    DIR *dir = opendir(bmp_path);
-    if (dir == NULL) {
-        fprintf(stderr, "Could not open directory.\n");
-        perror("Error");
-        abort();
+    size_t size = 0; // number of BMPs found (not known up-front for a stream)
+    run_stats stats;
+    init_stats(&stats);
+    unsigned long long stage_beg = get_time_ns();
+    bmp_stream in = {0};
+    dir_watch watch = {0};
+    if (opts.in_path) { // nothing to find or sort - the BMPs are converted in the order they arrive
+        if (!open_bmp_stream(&in, opts.in_path)) {
+            fprintf(stderr, "Input stream \"%s\" could not be opened.\n", opts.in_path);
+            perror("Error");
+            abort();
+        }
+        if (!in.have_headers) {
+            fprintf(stderr, BOLD_TXT(RED_TXT("Error: ")) CYAN_TXT(UNDERLINED_TXT("No BMPs found in input stream:"))
+            GREEN_TXT(" \"%s\"\n"), in.name);
+            abort();
+        }
     }
-#endif
-    array = malloc(sizeof(char*)*MIN_ARR_SIZE);
-    const char **ptr = array;
-    char *str;
-#ifdef _WIN32
-    do {
-        str = malloc(sizeof(char)*(MAX_PATH - len)); // MAX_PATH includes null-terminator
-        strcpy_c(str, bmp_path);
-        strcat_c(str, find.cFileName);
-        str = realloc(str, strlen_c(str) + 1);
-        *ptr++ = str;
-        ++size;
-        if (size >= MIN_ARR_SIZE && (size & (size - 1)) == 0) {
-            array = realloc(array, size*2*sizeof(char*));
-            ptr = array + size;
+    else if (opts.watch) { // BMPs already in the directory are taken first, then those rendered after
+        if (!start_watch(&watch, bmp_path, opts.sentinel ? opts.sentinel : DEF_SENTINEL,
+                         opts.watch_timeout ? opts.watch_timeout : DEF_WATCH_TIMEOUT, opts.natural))
+            abort();
+        stats.scan_ns = get_time_ns() - stage_beg; // the first scan, sort included
+        if (!peek_watched_bmp(&watch)) {
+            fprintf(stderr, BOLD_TXT(RED_TXT("Error: ")) CYAN_TXT(UNDERLINED_TXT("No BMPs appeared in directory:"))
+            GREEN_TXT(" \"%s\"\n"), bmp_path);
+            abort();
         }
-    } while(FindNextFileA(first, &find) != 0);
-#else
-    while((entry = readdir(dir)) != NULL) {
-        if (endswith(entry->d_name, ".bmp")) {
-            str = malloc(sizeof(char)*(4096 - len));
-            strcpy_c(str, bmp_path);
-            // strcat_c(str, "/");
-            strcat_c(str, entry->d_name);
-            str = realloc(str, strlen_c(str) + 1);
-            *ptr++ = str;
-            ++size;
-            if (size >= MIN_ARR_SIZE && (size & (size - 1)) == 0) {
-                array = realloc(array, size*2*sizeof(char*));
-                ptr = array + size;
-            }
+    }
+    else if (opts.list_path) { // the list is already in order, & its BMPs can be anywhere, so no scanning nor sorting
+        array = read_list(opts.list_path, &size);
+        if (!array)
+            abort();
+        stats.scan_ns = get_time_ns() - stage_beg;
+        if (!size) {
+            fprintf(stderr, BOLD_TXT(RED_TXT("Error: ")) CYAN_TXT(UNDERLINED_TXT("No BMP paths found in list:"))
+            GREEN_TXT(" \"%s\"\n"), opts.list_path);
+            abort();
         }
     }
-#endif
-    // *ptr = NULL;
-    if (!size) {
-        fprintf(stderr, BOLD_TXT(RED_TXT("Error: ")) CYAN_TXT(UNDERLINED_TXT("No BMP files found in directory:"))
-        GREEN_TXT(" \"%s\"\n"), bmp_path);
-        abort();
+    else {
+        array = scan_bmps(bmp_path, &size);
+        if (!array)
+            abort();
+        stats.scan_ns = get_time_ns() - stage_beg;
+        if (!size) {
+            fprintf(stderr, BOLD_TXT(RED_TXT("Error: ")) CYAN_TXT(UNDERLINED_TXT("No BMP files found in directory:"))
+            GREEN_TXT(" \"%s\"\n"), bmp_path);
+            abort();
+        }
+        stage_beg = get_time_ns();
+        if (opts.natural) // in case paths found are not in order, this sorts them
+            natural_sort(array);
+        else
+            alphabetical_sort(array);
+        stats.sort_ns = get_time_ns() - stage_beg;
     }
-    array = realloc(array, (size + 1)*(sizeof(char*)));
-    *(array + size) = NULL;
-    alphabetical_sort(array); // in case paths found are not in alphabetical order, this sorts them
-    const char **arr = array;
+    unsigned long long startup_ns = get_time_ns() - beg_ns; // time taken to find & order the frames
     char clr_space[5];
     clr_space[0] = 'C';
     clr_space[1] = *cmpr++;
     clr_space[2] = *cmpr++;
     clr_space[3] = *cmpr;
     clr_space[4] = 0;
-    FILE *bmp = fopen(*array, "rb");
-    if (bmp == NULL) {
-        fprintf(stderr, "Error trying to open file: %s\n", *array);
-        abort();
-    }
     bmp_header header;
     bmp_info_header info_header;
-    fread(&header, sizeof(char), sizeof(header), bmp);
+    if (opts.in_path) { // the headers of the first BMP have already been read in, & are left for the pipeline
+        header = *(const bmp_header *) in.headers;
+        info_header = *(const bmp_info_header *) (in.headers + sizeof(header));
+    }
+    else {
+        const char *first = opts.watch ? peek_watched_bmp(&watch) : *array;
+        FILE *bmp = fopen(first, "rb");
+        for (size_t i = 1; !bmp && opts.list_path && opts.resume && i < size; ++i) // the first may have been deleted
+            bmp = fopen(first = *(array + i), "rb");
+        if (bmp == NULL) {
+            fprintf(stderr, "Error trying to open file: %s\n", first);
+            abort();
+        }
+        fread(&header, sizeof(char), sizeof(header), bmp);
+        fread(&info_header, sizeof(char), sizeof(info_header), bmp);
+        fclose(bmp);
+    }
     if (header.px_arr_offset != PIX_OFFSET) {
         fprintf(stderr, "Invalid BMP format, offset expected = 54 bytes, offset found = %i\n", header.px_arr_offset);
         abort();
     }
-    fread(&info_header, sizeof(char), sizeof(info_header), bmp);
     if (info_header.pixel_depth != 24 && info_header.pixel_depth != 32) {
         fprintf(stderr, "Invalid BMP format, bit-depth expected: 24 bpp, depth found = %i bpp\n",
                 info_header.pixel_depth);
         abort();
     }
-    fclose(bmp);
     unsigned long width = info_header.bmp_width;
     unsigned long height = info_header.bmp_height;
     unsigned char padding = PAD_24BPP(info_header.bmp_width);
@@ -171,13 +171,13 @@ int main(int argc, char **argv) {
         }
         term_if_zero(width);
     }
-    if (strcmp_c(clr_space, "C420") == 0 || strcmp_c(clr_space, "C410")) {
+    if (strcmp_c(clr_space, "C420") == 0 || strcmp_c(clr_space, "C410") == 0) {
         if (info_header.bmp_height % 2 != 0) {
             --height;
         }
         term_if_zero(height);
     }
-    if (strcmp_c(clr_space, "C411") == 0 || strcmp_c(clr_space, "C410")) {
+    if (strcmp_c(clr_space, "C411") == 0 || strcmp_c(clr_space, "C410") == 0) {
         unsigned char rem = info_header.bmp_width % 4;
         if (rem != 0) {
             if (info_header.bmp_width <= rem) {
@@ -190,17 +190,96 @@ int main(int argc, char **argv) {
     char t[sizeof(char)*(UND_TIME_MAX_LEN + 12)];
     strcpy_c(t, "CREATED_ON=");
     strcat_c(t, curr_time);
-    yuv_h = yuv_header(width, height, rate_num, rate_denom, 'p', 1, 1, clr_space, t);
+    yuv_h = yuv_header(width, height, opts.rate_num, opts.rate_denom, 'p', 1, 1, clr_space, t);
     if (yuv_h == NULL) {
         fprintf(stderr, "Invalid parameters for YUV4MPEG2 file.\n");
         abort();
     }
-    FILE *vid;
-    if (vpath_given) {
-        vid_path = vpath_given;
-        vid = fopen(vpath_given, "wb");
-        if (vid == NULL) {
-            fprintf(stderr, "Error opening video output path: \"%s\"\n", vid_path);
+    pipeline pl = {0};
+    size_t total_reps = ((size_t) width)*height;
+    if (strcmp_c(clr_space, "C444") == 0) { // uncompressed case - BMP pixel array size = FRAME pixel array size
+        pl.frame_size = total_reps*sizeof(colour);
+        pl.kernel = kernels->out_444;
+        pl.kernel_name = "output_444";
+        pl.h_sub = 1;
+        pl.v_sub = 1;
+    }
+    else if (strcmp_c(clr_space, "C422") == 0) { // video frame size = (2/3) * BMP pixel array size
+        pl.frame_size = total_reps*2*sizeof(unsigned char);
+        pl.kernel = kernels->out_422;
+        pl.kernel_name = "output_422";
+        pl.h_sub = 2;
+        pl.v_sub = 1;
+    } // 4:2:0 sub-sampling is, in my opinion, the best choice, as quality is decent, and file size is cut in half
+    else if (strcmp_c(clr_space, "C420") == 0) { // video frame size = (1/2) * BMP pixel array size
+        pl.frame_size = (total_reps*3)/2;
+        pl.kernel = kernels->out_420;
+        pl.kernel_name = "output_420";
+        pl.h_sub = 2;
+        pl.v_sub = 2;
+    }
+    else if (strcmp_c(clr_space, "C411") == 0) { // C411 - video frame size = (1/2) * BMP pixel array size
+        pl.frame_size = (total_reps*3)/2;
+        pl.kernel = kernels->out_411;
+        pl.kernel_name = "output_411";
+        pl.h_sub = 4;
+        pl.v_sub = 1;
+    }
+    /* warning: to the best of my knowledge, 4:1:0 subsampling is not supported by any media player, not even VLC, and
+     * does not appear to be supported be a supported format by ffmpeg either */
+    else { // C410 - video frame size = (5/12) * BMP pixel array size
+        fprintf(msgs, MAGENTA_TXT(BOLD_TXT("Warning:"))
+               YELLOW_TXT(" 4:1:0 colour subsampling is a mostly unsupported format: consider using 4:2:0 instead.\n"));
+        pl.frame_size = (5*total_reps)/4;
+        pl.kernel = kernels->out_410;
+        pl.kernel_name = "output_410";
+        pl.h_sub = 4;
+        pl.v_sub = 2;
+    }
+    checkpoint ckpt = {0};
+    pl.paths = array;
+    pl.in = opts.in_path ? &in : NULL;
+    pl.watch = opts.watch ? &watch : NULL;
+    pl.num_frames = opts.in_path || opts.watch ? SIZE_MAX : size;
+    pl.width = width;
+    pl.height = height;
+    pl.bmp_width = info_header.bmp_width;
+    pl.bmp_height = info_header.bmp_height;
+    pl.row_size = ((size_t) info_header.bmp_width)*3 + padding;
+    pl.stride = -((ptrdiff_t) pl.row_size); // a trimmed row or column is simply never read
+    pl.del = opts.del && !opts.in_path; // a stream leaves no files behind to delete
+    pl.sync_every = opts.sync_every;
+    pl.prog = opts.prog;
+    pl.prog_rate = opts.prog_rate;
+    pl.msgs = msgs;
+    pl.num_converters = opts.jobs ? opts.jobs : get_num_cpus();
+    pl.num_readers = opts.readers;
+    pl.num_slots = opts.queue_depth ? opts.queue_depth : pl.num_converters + pl.num_readers + 2;
+    pl.num_stripes = opts.stripes;
+    pl.ckpt = &ckpt;
+    pl.cache_size = opts.dedup;
+    pl.incremental = opts.incremental;
+    pl.diff = kernels->diff;
+    pl.stats = opts.stats != STATS_NONE ? &stats : NULL;
+    if (opts.trace_path && !start_trace(opts.trace_path))
+        abort();
+    if (opts.dry_run) { // nothing is written - the sample of frames is converted into the void
+        int status = dry_run(&pl, opts.stream, opts.vid_path ? opts.vid_path : bmp_path, strlen_c(yuv_h));
+        finish_trace();
+        return status;
+    }
+    video_out vid;
+    size_t frames_done = 0; // number of frames already in the video being resumed
+    if (opts.resume) {
+        if (!init_checkpoint(&ckpt, opts.vid_path)) {
+            fprintf(stderr, "Memory allocation error when setting up the checkpoint.\n");
+            abort();
+        }
+        ckpt.base = frames_done = resume_video(&vid, opts.vid_path, yuv_h, pl.frame_size, &ckpt);
+    }
+    else if (opts.vid_path) {
+        if (!open_video(&vid, opts.vid_path, pl.frame_size)) {
+            fprintf(stderr, "Error opening video output path: \"%s\"\n", opts.vid_path);
             perror("Error type");
             abort();
         }
@@ -216,231 +295,123 @@ int main(int argc, char **argv) {
         strcat_c(vid_path, "Y4M_Video_");
         strcat_c(vid_path, curr_time);
         strcat_c(vid_path, ".y4m");
-        vid = fopen(vid_path, "wb");
-        if (vid == NULL) {
+        if (!open_video(&vid, vid_path, pl.frame_size)) {
             fprintf(stderr, "Error opening video output path: \"%s\"\n", vid_path);
             perror("Error type");
             abort();
         }
-        free(vid_path);
     }
-    vid_path = NULL;
-    fwrite(yuv_h, sizeof(char), strlen_c(yuv_h), vid);
+    if (!opts.resume)
+        write_video(&vid, yuv_h, strlen_c(yuv_h));
     free((char *) yuv_h);
     yuv_h = NULL;
-    long start_offset = -((long) (info_header.bmp_width*3 + padding)); // same for all colour sub-sampling cases
-    long repeat_offset = -((long) ((width + info_header.bmp_width)*3 + padding));
-    colours = malloc(width*height*sizeof(colour)); // I have opted for heap alloc. to avoid repeated calls to
-    if (!colours) { // fread(), the tests I have run have shown the comp. time to have been reduced by at least 60%
-        fprintf(stderr, "Memory allocation error, likely due to overly large BMP file size.\n");
-        abort();
-    }
-    unsigned char *fclr_ptr;
-    colour *clr_ptr;
-    unsigned int total_reps = width*height; // guaranteed to never be larger than 4294967295
-    unsigned int i; // loop counter
-    size_t frame_size; // size of a single frame in the .y4m video
-    unsigned int frames = 0;
-    if (strcmp_c(clr_space, "C444") == 0) { // uncompressed case - BMP pixel array size = FRAME pixel array size
-        frame_size = total_reps*sizeof(colour);
-        final_clrs = malloc(frame_size);
-        for (;*arr; ++arr) { // lots of repetition below, but better to avoid function calls
-            start_frame(vid); // each frame starts with "FRAME\n"
-            bmp = fopen(*arr, "rb");
-            if (!bmp) {
-                fprintf(stderr, "File \"%s\" could not be opened.\n", *arr);
-                return 1;
-            }
-            check_dim(bmp, *arr);
-            fseek(bmp, start_offset, SEEK_END); // seek to end row of pixel array in BMP
-            clr_ptr = colours;
-            for (i = 0; i < height; ++i) { // read in image in inverse row order
-                fread(clr_ptr, sizeof(colour), width, bmp);
-                fseek(bmp, repeat_offset, SEEK_CUR); // seek to previous row (y4m videos are inverted compared to BMPs)
-                clr_ptr += width;
-            }
-            fclose(bmp);
-            if (delete) // not great to re-evaluate this within loop, but leads to cleaner code, and <0.0001% extra time
-                if (remove(*arr)) {
-                    fprintf(stderr, "Error occurred when trying to delete file \"%s\".\n", *arr);
-                    abort();
-                }
-            clr_ptr = colours;
-            fclr_ptr = final_clrs;
-            output_444(clr_ptr, fclr_ptr, total_reps);
-            fwrite(fclr_ptr, sizeof(unsigned char), frame_size, vid);
-            if (prog) {
-                printf(GREEN_TXT(UNDERLINED_TXT("Frames completed:")) MAGENTA_TXT(BOLD_TXT(" %i"))
-                       YELLOW_TXT(" / ") BLUE_TXT(BOLD_TXT("%zu\r")), ++frames, size);
-                fflush(stdout);
-            }
+    size_t skipped = 0; // input frames skipped over, their frames already being in the video
+    size_t to_skip = frames_done;
+    if (opts.resume && !frames_done) // a new video - any record of deletions is for one written before
+        remove(ckpt.del_path);
+    if (frames_done) {
+        size_t deleted = read_deletions(&ckpt); // BMPs of frames in the video that a scan or watch won't find
+        if (deleted > frames_done) {
+            fprintf(stderr, "Video \"%s\" has %zu frames, but the BMPs of %zu frames were deleted.\n", opts.vid_path,
+                    frames_done, deleted);
+            abort();
         }
-    }
-    else if (strcmp_c(clr_space, "C422") == 0) { // video frame size = (2/3) * BMP pixel array size
-        frame_size = total_reps*2*sizeof(unsigned char);
-        final_clrs = malloc(frame_size);
-        for (; *arr; ++arr) {
-            start_frame(vid);
-            bmp = fopen(*arr, "rb");
-            if (!bmp) {
-                fprintf(stderr, "File \"%s\" could not be opened.\n", *arr);
-                abort();
-            }
-            check_dim(bmp, *arr);
-            fseek(bmp, start_offset, SEEK_END);
-            clr_ptr = colours;
-            for (i = 0; i < height; ++i) {
-                fread(clr_ptr, sizeof(colour), width, bmp);
-                fseek(bmp, repeat_offset, SEEK_CUR);
-                clr_ptr += width;
-            }
-            fclose(bmp);
-            if (delete)
-                if (remove(*arr)) {
-                    fprintf(stderr, "Error occurred when trying to delete file \"%s\".\n", *arr);
-                    return 1;
-                }
-            clr_ptr = colours;
-            fclr_ptr = final_clrs;
-            output_422(clr_ptr, fclr_ptr, total_reps);
-            fwrite(fclr_ptr, sizeof(unsigned char), frame_size, vid);
-            if (prog) {
-                printf(GREEN_TXT(UNDERLINED_TXT("Frames completed:")) MAGENTA_TXT(BOLD_TXT(" %i"))
-                       YELLOW_TXT(" / ") BLUE_TXT(BOLD_TXT("%zu\r")), ++frames, size);
-                fflush(stdout);
-            }
+        if (!opts.in_path && !opts.list_path) // a list still names the deleted BMPs, which are then skipped over
+            to_skip -= deleted;
+        if (opts.in_path) {
+            unsigned char *buf = NULL;
+            size_t buf_size = 0;
+            for (; skipped < to_skip && read_stream_bmp(&in, &buf, &buf_size); ++skipped);
+            free(buf);
         }
-    } // 4:2:0 sub-sampling is, in my opinion, the best choice, as quality is decent, and file size is cut in half
-    else if (strcmp_c(clr_space, "C420") == 0) { // video frame size = (1/2) * BMP pixel array size
-        if (height != info_header.bmp_height) {
-            start_offset -= (long) (padding + 3*info_header.bmp_width);
+        else if (opts.watch) {
+            for (const char *path; skipped < to_skip && (path = next_watched_bmp(&watch)); ++skipped)
+                if (pl.del) // its frame is in the video, but it wasn't deleted before the conversion stopped
+                    delete_bmp(&ckpt, path);
         }
-        frame_size = (total_reps*3)/2;
-        fclr_ptr = malloc(frame_size);
-        for (; *arr; ++arr) {
-            start_frame(vid);
-            bmp = fopen(*arr, "rb");
-            if (!bmp) {
-                fprintf(stderr, "File \"%s\" could not be opened.\n", *arr);
-                abort();
-            }
-            check_dim(bmp, *arr);
-            fseek(bmp, start_offset, SEEK_END);
-            clr_ptr = colours;
-            for (i = 0; i < height; ++i) {
-                fread(clr_ptr, sizeof(colour), width, bmp);
-                fseek(bmp, repeat_offset, SEEK_CUR);
-                clr_ptr += width;
-            }
-            fclose(bmp);
-            if (delete)
-                if (remove(*arr)) {
-                    fprintf(stderr, "Error occurred when trying to delete file \"%s\".\n", *arr);
-                    abort();
+        else {
+            skipped = to_skip < size ? to_skip : size;
+            for (size_t i = 0; pl.del && i < skipped; ++i) { // the BMPs not deleted before the conversion stopped
+                FILE *bmp = fopen(*(pl.paths + i), "rb"); // those listed may be gone already
+                if (bmp) {
+                    fclose(bmp);
+                    delete_bmp(&ckpt, *(pl.paths + i));
                 }
-            clr_ptr = colours;
-            output_420(clr_ptr, fclr_ptr, width, height);
-            fwrite(fclr_ptr, sizeof(unsigned char), frame_size, vid);
-            if (prog) {
-                printf(GREEN_TXT(UNDERLINED_TXT("Frames completed:")) MAGENTA_TXT(BOLD_TXT(" %i"))
-                       YELLOW_TXT(" / ") BLUE_TXT(BOLD_TXT("%zu\r")), ++frames, size);
-                fflush(stdout);
             }
+            pl.paths += skipped;
+            pl.num_frames -= skipped;
         }
-    }
-    else if (strcmp_c(clr_space, "C411") == 0) { // C411 - video frame size = (1/2) * BMP pixel array size
-        frame_size = (total_reps*3)/2;
-        fclr_ptr = malloc(frame_size);
-        for (; *arr; ++arr) {
-            start_frame(vid);
-            bmp = fopen(*arr, "rb");
-            if (!bmp) {
-                fprintf(stderr, "File \"%s\" could not be opened.\n", *arr);
-                abort();
-            }
-            check_dim(bmp, *arr);
-            fseek(bmp, start_offset, SEEK_END);
-            clr_ptr = colours;
-            for (i = 0; i < height; ++i) {
-                fread(clr_ptr, sizeof(colour), width, bmp);
-                fseek(bmp, repeat_offset, SEEK_CUR);
-                clr_ptr += width;
-            }
-            fclose(bmp);
-            if (delete)
-                if (remove(*arr)) {
-                    fprintf(stderr, "Error occurred when trying to delete file \"%s\".\n", *arr);
-                    abort();
-                }
-            clr_ptr = colours;
-            output_411(clr_ptr, fclr_ptr, total_reps);
-            fwrite(fclr_ptr, sizeof(unsigned char), frame_size, vid);
-            if (prog) {
-                printf(GREEN_TXT(UNDERLINED_TXT("Frames completed:")) MAGENTA_TXT(BOLD_TXT(" %i"))
-                       YELLOW_TXT(" / ") BLUE_TXT(BOLD_TXT("%zu\r")), ++frames, size);
-                fflush(stdout);
-            }
+        if (skipped < to_skip && !stop_requested) { // SIGINT stops the skipping as if the stream had ended
+            fprintf(stderr, "Video \"%s\" already has %zu frames, but there are only %zu BMPs to convert.\n",
+                    opts.vid_path, frames_done, skipped + frames_done - to_skip);
+            abort();
         }
     }
-    /* warning: to the best of my knowledge, 4:1:0 subsampling is not supported by any media player, not even VLC, and
-     * does not appear to be supported be a supported format by ffmpeg either */
-    else { // C410 - video frame size = (5/12) * BMP pixel array size
-        printf(MAGENTA_TXT(BOLD_TXT("Warning:"))
-               YELLOW_TXT(" 4:1:0 colour subsampling is a mostly unsupported format: consider using 4:2:0 instead.\n"));
-        if (height != info_header.bmp_height) {
-            start_offset -= (long) (padding + 3*info_header.bmp_width);
-        }
-        frame_size = (5*total_reps)/4;
-        fclr_ptr = malloc(frame_size);
-        for (; *arr; ++arr) {
-            start_frame(vid);
-            bmp = fopen(*arr, "rb");
-            if (!bmp) {
-                fprintf(stderr, "File \"%s\" could not be opened.\n", *arr);
-                abort();
-            }
-            check_dim(bmp, *arr);
-            fseek(bmp, start_offset, SEEK_END);
-            clr_ptr = colours;
-            for (i = 0; i < height; ++i) {
-                fread(clr_ptr, sizeof(colour), width, bmp);
-                fseek(bmp, repeat_offset, SEEK_CUR);
-                clr_ptr += width;
-            }
-            fclose(bmp);
-            if (delete)
-                if (remove(*arr)) {
-                    fprintf(stderr, "Error occurred when trying to delete file \"%s\".\n", *arr);
-                    return 1;
-                }
-            clr_ptr = colours;
-            output_410(clr_ptr, fclr_ptr, width, height);
-            fwrite(fclr_ptr, sizeof(unsigned char), frame_size, vid);
-            if (prog) {
-                printf(GREEN_TXT(UNDERLINED_TXT("Frames completed:")) MAGENTA_TXT(BOLD_TXT(" %i"))
-                       YELLOW_TXT(" / ") BLUE_TXT(BOLD_TXT("%zu\r")), ++frames, size);
-                fflush(stdout);
+    if (pl.num_frames && pl.num_frames != SIZE_MAX) {
+        const char *path = opts.vid_path ? opts.vid_path : vid_path;
+        size_t needed = video_bytes(pl.num_frames, pl.frame_size);
+        if (pl.del && same_filesystem(path, *pl.paths)) // the BMPs deleted make way for the video, if not straight away
+            needed = space_needed(pl.num_frames, video_bytes(1, pl.frame_size), pl.row_size*pl.bmp_height,
+                                  pl.sync_every);
+        size_t avail = vid.fp && vid.fp != stdout ? free_space(path) : SIZE_MAX;
+        if ((avail != SIZE_MAX && avail < needed) || !reserve_video(&vid, needed)) {
+            fprintf(stderr, BOLD_TXT(RED_TXT("Error: ")) CYAN_TXT(UNDERLINED_TXT("Not enough space for video"))
+            GREEN_TXT(" \"%s\"") CYAN_TXT(": %zu bytes needed, %zu available.\n"), path, needed,
+                    avail == SIZE_MAX ? 0 : avail);
+            if (!opts.resume) { // the video would only have its header
+                close_video(&vid);
+                remove(path);
             }
+            abort();
         }
     }
-    free(colours);
-    colours = NULL;
-    free(final_clrs);
-    final_clrs = NULL;
-    size_t y4m_file_size = ftell(vid); // will be very big!!!
-    fclose(vid);
-    if (prog)
-        putchar('\n');
-    free_array(array);
+    if (!pl.num_frames)
+        fprintf(msgs, "Video \"%s\" is already complete.\n", opts.vid_path);
+    else if (opts.stream)
+        run_stream(&pl, &vid); // same output, but only holding a few rows of one frame in memory at a time
+    else
+        run_pipeline(&pl, &vid); // reads, converts & writes all the frames
+    finish_trace(); // all the other threads have finished by now
+    if (opts.in_path) {
+        close_bmp_stream(&in);
+        size = pl.num_frames;
+    }
+    else if (opts.watch) {
+        stop_watch(&watch);
+        size = pl.num_frames;
+    }
+    size_t y4m_file_size = vid.size; // will be very big!!!
+    if (stop_requested) // the pipeline has stopped early, after writing a checkpoint
+        fprintf(stderr, "Interrupted after %zu frames: %s\n", ckpt.base + pl.num_frames, opts.resume ?
+                "run again with the same options to resume." : "the video is valid, but can only be resumed when "
+                "\"-resume\" is used.");
+    close_video(&vid);
+    finish_checkpoint(&ckpt, !stop_requested);
+    stats.elapsed_ns = get_time_ns() - beg_ns;
+    free(vid_path); // kept until now for any write error messages
+    vid_path = NULL;
+    free(array);
     array = NULL;
-    if (give_size) {
-        printf("File size: %zu bytes\n", y4m_file_size);
+    if (opts.dedup)
+        fprintf(msgs, "Frames reused: %zu / %zu\n", pl.num_reused, pl.num_frames);
+    if (opts.incremental && pl.num_frames)
+        fprintf(msgs, "Tiles converted: %zu / %zu\n", pl.num_tiles, pl.num_frames*pl.tiles_x*pl.tiles_y);
+    if (opts.sized) {
+        fprintf(msgs, "File size: %zu bytes\n", y4m_file_size);
     }
-    if (timed) {
-        time_t total_time = time(NULL) - beg_time;
-        printf(total_time == 1 ? "Elapsed time: %zu second\n" : "Elapsed time: %zu seconds\n", (size_t) total_time);
+    if (opts.timed) {
+        if (opts.in_path || opts.watch)
+            fprintf(msgs, opts.watch ? "Startup time: %.3f ms (%zu BMPs watched for)\n" :
+                    "Startup time: %.3f ms (%zu BMPs streamed)\n", startup_ns/1e6, size);
+        else
+            fprintf(msgs, opts.list_path ? "Startup time: %.3f ms (%zu BMPs listed)\n" :
+                    "Startup time: %.3f ms (%zu BMPs found & sorted)\n", startup_ns/1e6, size);
+        fprintf(msgs, "Elapsed time: %.3f seconds\n", stats.elapsed_ns/1e9);
     }
-    return 0;
+    if (opts.stats != STATS_NONE)
+        print_stats(&stats, msgs, opts.stats == STATS_JSON);
+    free_stats(&stats);
+    return stop_requested ? 130 : 0; // the usual exit code for SIGINT
 }
 
 static inline void term_if_zero(size_t val) {
@@ -449,3 +420,49 @@ static inline void term_if_zero(size_t val) {
         abort();
     }
 }
+
+/* prints the size the video would have, whether it would fit, & how long it would take to make, going by how long a
+ * sample of its frames spread out over the sequence takes to read & convert (the frames being written to the null
+ * device, so the time the disk takes to write the video isn't accounted for). Returns the exit status */
+static int dry_run(pipeline *pl, bool stream, const char *vid_path, size_t header_len) {
+    size_t num_frames = pl->num_frames;
+    size_t video_size = header_len + video_bytes(num_frames, pl->frame_size);
+    size_t avail = equal(vid_path, "-") ? SIZE_MAX : free_space(vid_path);
+    size_t needed = video_size;
+    if (pl->del && num_frames && same_filesystem(vid_path, *pl->paths)) // the BMPs deleted make way for the video
+        needed = header_len + space_needed(num_frames, video_bytes(1, pl->frame_size), pl->row_size*pl->bmp_height,
+                                           pl->sync_every);
+    size_t num_samples = num_frames < DRY_RUN_SAMPLES ? num_frames : DRY_RUN_SAMPLES;
+    const char *samples[DRY_RUN_SAMPLES];
+    for (size_t i = 0; i < num_samples; ++i)
+        samples[i] = *(pl->paths + i*num_frames/num_samples);
+    video_out null_vid;
+    if (!open_video(&null_vid, NULL_DEVICE, pl->frame_size)) {
+        fprintf(stderr, "Error opening \"" NULL_DEVICE "\" to convert the sample frames into.\n");
+        abort();
+    }
+    pl->paths = samples;
+    pl->num_frames = num_samples;
+    pl->del = false;
+    pl->prog = false;
+    unsigned long long beg_ns = get_time_ns();
+    if (stream)
+        run_stream(pl, &null_vid);
+    else
+        run_pipeline(pl, &null_vid);
+    unsigned long long sample_ns = get_time_ns() - beg_ns;
+    close_video(&null_vid);
+    double secs = sample_ns/1e9*num_frames/pl->num_frames; // fewer frames than sampled if stopped by SIGINT
+    fprintf(pl->msgs, "Frames: %zu (%ux%u)\nVideo size: %zu bytes (%.2f GiB)\n", num_frames, pl->width, pl->height,
+            video_size, video_size/1073741824.0);
+    if (avail != SIZE_MAX)
+        fprintf(pl->msgs, "Free space: %zu bytes (%.2f GiB)\n", avail, avail/1073741824.0);
+    fprintf(pl->msgs, "Estimated time: %.1f seconds (%.1f frames per second, from %zu sample frames - not counting "
+                      "the time taken to write the video to disk)\n", secs, num_frames/secs, pl->num_frames);
+    if (avail != SIZE_MAX && avail < needed) {
+        fprintf(stderr, BOLD_TXT(RED_TXT("Error: ")) CYAN_TXT(UNDERLINED_TXT("Not enough space for video"))
+        GREEN_TXT(" \"%s\"") CYAN_TXT(": %zu bytes needed, %zu available.\n"), vid_path, needed, avail);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,327 @@
+//
+// writing the video out - to a file, or straight to stdout (& so to whatever is reading the other end of the pipe)
+//
+
+#pragma once
+
+#include "overhead.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/statvfs.h>
+#endif
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#endif
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+#define PIPE_SIZE (1 << 20) // pipe capacity asked for when splicing frames, cutting down on context switches
+
+/* When stdout is a pipe (e.g. "videogen -o - | ffmpeg -i - ..."), each frame is vmsplice()d into it on Linux: the pipe
+ * then refers to the pages of the frame buffer itself rather than to a copy of them, so the only copy left is the one
+ * the consumer makes when reading. In exchange, a frame buffer must not be touched until the consumer has read all of
+ * it, which is only known for sure once as much data as the pipe can hold has been written after it - so splicing is
+ * only used when the pipe holds no more than a frame (see out->spliced), & the buffer of each frame is held onto until
+ * the next one has been written. Anything else written to stdout goes through writev() (a single system call for the
+ * "FRAME" line & the frame), & files are written through stdio as before. Write errors abort, with a clearer message
+ * when it's the reader that has gone away (EPIPE - SIGPIPE is ignored so that it's reported as an error instead).
+ * Every frame takes up the same number of bytes in the video, so when the video is a regular file, each frame's offset
+ * is known before any of the frames before it have been written: frames can then be written with pwrite() straight
+ * into place, by whichever thread converted them, in any order (see start_positioned()). The planes of each frame go
+ * in before its "FRAME" line, so that a frame whose "FRAME" line is there has been written in full, even if the
+ * conversion stopped while the frames around it were still being written. */
+typedef struct {
+    FILE *fp; // NULL when writing to stdout's file descriptor directly
+    int fd;
+    bool spliced; // whether frames are vmsplice()d rather than copied into the pipe
+    bool positioned; // whether frames are written at their offsets with write_frame_at() rather than in order
+    size_t first_offset; // offset of the first frame written when positioned
+    bool reserved; // whether space has been set aside for the frames still to be written (see reserve_video())
+    size_t size; // number of bytes written so far
+    const char *name; // how the output is referred to in error messages
+} video_out;
+
+_Noreturn static void video_write_error(const video_out *out) {
+#ifdef EPIPE
+    if (errno == EPIPE) {
+        fprintf(stderr, "Video output \"%s\" was closed by its reader after %zu bytes.\n", out->name, out->size);
+        abort();
+    }
+#endif
+    fprintf(stderr, "Error writing to video output \"%s\".\n", out->name);
+    perror("Error type");
+    abort();
+}
+
+// sets all of out's fields to those of a video that has nothing written to it yet - before it's opened in any way
+void init_video(video_out *out, const char *name) {
+    out->fp = NULL;
+    out->fd = -1;
+    out->spliced = false;
+    out->positioned = false;
+    out->first_offset = 0;
+    out->reserved = false;
+    out->size = 0;
+    out->name = name;
+}
+
+/* opens path for writing, or stdout if path is "-", returning false if the file can't be opened - frame_size is used to
+ * decide whether a pipe can be spliced into */
+bool open_video(video_out *out, const char *path, size_t frame_size) {
+    init_video(out, path);
+    if (!equal(path, "-")) {
+        out->fp = fopen(path, "wb");
+        return out->fp != NULL;
+    }
+    out->name = "standard output";
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+    out->fp = stdout;
+#else
+    signal(SIGPIPE, SIG_IGN); // a reader exiting early then shows up as EPIPE, rather than killing the process
+    out->fd = STDOUT_FILENO;
+#if defined(__linux__) && defined(F_GETPIPE_SZ)
+    struct stat buff;
+    if (fstat(out->fd, &buff) == 0 && S_ISFIFO(buff.st_mode)) {
+        if (frame_size >= PIPE_SIZE)
+            fcntl(out->fd, F_SETPIPE_SZ, PIPE_SIZE); // just a hint - the limit for unprivileged users may be lower
+        int pipe_size = fcntl(out->fd, F_GETPIPE_SZ);
+        out->spliced = pipe_size > 0 && (size_t) pipe_size <= frame_size;
+    }
+#endif
+#endif
+    return true;
+}
+
+#ifndef _WIN32
+static void write_iov(video_out *out, struct iovec *iov, int count) { // writes all of the buffers out, in order
+    ssize_t num_written;
+    while (count) {
+#if defined(__linux__) && defined(F_GETPIPE_SZ)
+        if (out->spliced)
+            num_written = vmsplice(out->fd, iov, (unsigned long) count, 0);
+        else
+#endif
+            num_written = writev(out->fd, iov, count);
+        if (num_written < 0) {
+            if (errno == EINTR)
+                continue;
+            video_write_error(out);
+        }
+        out->size += (size_t) num_written;
+        for (; count && (size_t) num_written >= iov->iov_len; ++iov, --count) // skip past what has been written
+            num_written -= (ssize_t) iov->iov_len;
+        if (count) {
+            iov->iov_base = (char *) iov->iov_base + num_written;
+            iov->iov_len -= (size_t) num_written;
+        }
+    }
+}
+#endif
+
+void write_video(video_out *out, const void *data, size_t size) {
+    if (out->fp) {
+        if (fwrite(data, sizeof(unsigned char), size, out->fp) != size)
+            video_write_error(out);
+        out->size += size;
+        return;
+    }
+#ifndef _WIN32
+    struct iovec iov = {(void *) data, size};
+    bool spliced = out->spliced;
+    out->spliced = false; // only frame buffers are kept around for long enough to be spliced
+    write_iov(out, &iov, 1);
+    out->spliced = spliced;
+#endif
+}
+
+static const char frame_line[] = "FRAME\n"; // each frame starts with this
+
+static inline size_t video_bytes(size_t num_frames, size_t frame_size) { // size of that many frames in the video
+    return num_frames*(sizeof(frame_line) - 1 + frame_size);
+}
+
+static char *dir_of(const char *path) { // directory the file at path is (or would be) in - NULL if out of memory
+    size_t len = strlen_c(path);
+    char *dir = malloc(len + 2);
+    if (!dir)
+        return NULL;
+    size_t dir_len = len;
+    while (dir_len && *(path + dir_len - 1) != '/' && *(path + dir_len - 1) != file_sep())
+        --dir_len;
+    for (size_t i = 0; i < dir_len; ++i)
+        *(dir + i) = *(path + i);
+    if (!dir_len) // in the working directory
+        *(dir + dir_len++) = '.';
+    *(dir + dir_len) = 0;
+    return dir;
+}
+
+// free space (in bytes) on the filesystem the file at path is (or would be) on - SIZE_MAX if it can't be found out
+size_t free_space(const char *path) {
+    char *dir = dir_of(path);
+    if (!dir)
+        return SIZE_MAX;
+#ifdef _WIN32
+    ULARGE_INTEGER avail;
+    size_t space = GetDiskFreeSpaceExA(dir, &avail, NULL, NULL) ? (size_t) avail.QuadPart : SIZE_MAX;
+#else
+    struct statvfs st;
+    size_t space = statvfs(dir, &st) == 0 ? (size_t) st.f_bavail*st.f_frsize : SIZE_MAX;
+#endif
+    free(dir);
+    return space;
+}
+
+// whether the files at path_a & path_b are (or would be) on the same filesystem - false if it can't be found out
+bool same_filesystem(const char *path_a, const char *path_b) {
+    char *dir_a = dir_of(path_a);
+    char *dir_b = dir_of(path_b);
+    bool same = false;
+    if (dir_a && dir_b) {
+#ifdef _WIN32
+        char vol[MAX_PATH];
+        DWORD serial_a;
+        DWORD serial_b;
+        same = GetVolumePathNameA(dir_a, vol, MAX_PATH) && GetVolumeInformationA(vol, NULL, 0, &serial_a, NULL, NULL,
+                                                                                  NULL, 0) &&
+               GetVolumePathNameA(dir_b, vol, MAX_PATH) && GetVolumeInformationA(vol, NULL, 0, &serial_b, NULL, NULL,
+                                                                                  NULL, 0) && serial_a == serial_b;
+#else
+        struct stat st_a;
+        struct stat st_b;
+        same = stat(dir_a, &st_a) == 0 && stat(dir_b, &st_b) == 0 && st_a.st_dev == st_b.st_dev;
+#endif
+    }
+    free_ptrs(2, dir_a, dir_b);
+    return same;
+}
+
+/* sets aside size more bytes for the video on disk, after what has been written so far, without changing its size -
+ * so the filesystem can lay the frames out contiguously, & there's no running out of space part-way through. Returns
+ * false if there isn't enough space - the video is left as it was. Quietly does nothing where that isn't supported
+ * (by the OS or the filesystem), or when the video isn't a file */
+bool reserve_video(video_out *out, size_t size) {
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+    if (!out->fp || out->fp == stdout || !size)
+        return true;
+    int err;
+    while ((err = fallocate(fileno(out->fp), FALLOC_FL_KEEP_SIZE, (off_t) out->size, (off_t) size)) == -1 &&
+           errno == EINTR);
+    if (err == -1)
+        return errno != ENOSPC && errno != EFBIG;
+    out->reserved = true;
+#endif
+    return true;
+}
+
+// writes a frame out, along with the "FRAME" line before it - see above for when its buffer can be reused
+void write_frame(video_out *out, const unsigned char *frame, size_t frame_size) {
+    if (out->fp) {
+        start_frame(out->fp);
+        if (fwrite(frame, sizeof(unsigned char), frame_size, out->fp) != frame_size)
+            video_write_error(out);
+        out->size += sizeof(frame_line) - 1 + frame_size;
+        return;
+    }
+#ifndef _WIN32
+    struct iovec iov[2] = {{(void *) frame_line, sizeof(frame_line) - 1}, {(void *) frame, frame_size}};
+    write_iov(out, iov, 2);
+#endif
+}
+
+/* switches to writing frames at their offsets, if the video is a regular file - the frames written from then on are
+ * numbered from 0, the first one going where the video currently ends. Returns false if the video can't be written to
+ * this way, in which case nothing has changed */
+bool start_positioned(video_out *out) {
+#ifdef _WIN32
+    return false;
+#else
+    struct stat buff;
+    if (!out->fp || out->fp == stdout || fflush(out->fp) || fstat(fileno(out->fp), &buff) || !S_ISREG(buff.st_mode))
+        return false;
+    long pos = ftell(out->fp);
+    if (pos < 0)
+        return false;
+    out->fd = fileno(out->fp);
+    out->first_offset = (size_t) pos;
+    out->positioned = true;
+    return true;
+#endif
+}
+
+#ifndef _WIN32
+static void pwrite_all(const video_out *out, const void *data, size_t size, size_t offset) {
+    ssize_t num_written;
+    while (size) {
+        num_written = pwrite(out->fd, data, size, (off_t) offset);
+        if (num_written < 0) {
+            if (errno == EINTR)
+                continue;
+            video_write_error(out);
+        }
+        data = (const char *) data + num_written;
+        size -= (size_t) num_written;
+        offset += (size_t) num_written;
+    }
+}
+#endif
+
+/* writes frame number index (counting from where start_positioned() was called) into place - safe to call from any
+ * thread, for any frame, in any order. out->size is left for the caller to update once the frames before are written */
+void write_frame_at(const video_out *out, const unsigned char *frame, size_t frame_size, size_t index) {
+#ifndef _WIN32
+    size_t offset = out->first_offset + index*(sizeof(frame_line) - 1 + frame_size);
+    pwrite_all(out, frame, frame_size, offset + sizeof(frame_line) - 1);
+    pwrite_all(out, frame_line, sizeof(frame_line) - 1, offset); // last - see above
+#endif
+}
+
+// goes back to writing the video in order, after the first num_frames frames, dropping any written after those
+void end_positioned(video_out *out, size_t num_frames, size_t frame_size) {
+    if (!out->positioned)
+        return;
+    out->positioned = false;
+#ifndef _WIN32
+    size_t end = out->first_offset + num_frames*(sizeof(frame_line) - 1 + frame_size);
+    if (ftruncate(out->fd, (off_t) end) || fseek(out->fp, (long) end, SEEK_SET))
+        video_write_error(out);
+    out->fd = -1;
+#endif
+}
+
+void drain_video(const video_out *out) { // waits for the reader to finish with all spliced frames, before they're freed
+#ifdef __linux__
+    int pending;
+    if (out->spliced)
+        while (ioctl(out->fd, FIONREAD, &pending) == 0 && pending > 0)
+            nanosleep(&(struct timespec) {0, 1000000}, NULL);
+#endif
+}
+
+void close_video(video_out *out) {
+#ifndef _WIN32
+    if (out->reserved && out->fp) { // gives back any space set aside for frames that were never written
+        if (fflush(out->fp) || ftruncate(fileno(out->fp), (off_t) ftell(out->fp)))
+            video_write_error(out);
+        out->reserved = false;
+    }
+#endif
+    if (out->fp && out->fp != stdout) {
+        if (fclose(out->fp))
+            video_write_error(out);
+    }
+    else if (out->fp && fflush(out->fp))
+        video_write_error(out);
+    out->fp = NULL;
+}
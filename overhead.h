@@ -6,11 +6,17 @@
 
 #define Y4M_VERSION "1.0.0"
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // for vmsplice() & the pipe size fcntl()s - has to come before any system header
+#endif
+
 #include <stdio.h>
 #include <stdarg.h>
 #include <time.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -168,7 +174,7 @@ static inline unsigned char get_Cb_avg8(const colour col, const colour col2, con
     long double ld6 = -0.169l*((long double)col6.r)-0.331l*((long double)col6.g)+0.500l*((long double)col6.b) + 128;
     long double ld7 = -0.169l*((long double)col7.r)-0.331l*((long double)col7.g)+0.500l*((long double)col7.b) + 128;
     long double ld8 = -0.169l*((long double)col8.r)-0.331l*((long double)col8.g)+0.500l*((long double)col8.b) + 128;
-    long double avg = ((ld + ld2 + ld3 + ld4 + ld5 + ld6 + ld7 + ld8)/4);
+    long double avg = ((ld + ld2 + ld3 + ld4 + ld5 + ld6 + ld7 + ld8)/8);
     unsigned char retval = (unsigned char) avg;
     if (avg - retval >= 0.5 && retval != 255) {
         ++retval;
@@ -219,13 +225,89 @@ static inline unsigned char get_Cr_avg8(const colour col, const colour col2, con
     long double ld6 = 0.500l*((long double)col6.r)-0.419l*((long double)col6.g)-0.081l*((long double)col6.b) + 128;
     long double ld7 = 0.500l*((long double)col7.r)-0.419l*((long double)col7.g)-0.081l*((long double)col7.b) + 128;
     long double ld8 = 0.500l*((long double)col8.r)-0.419l*((long double)col8.g)-0.081l*((long double)col8.b) + 128;
-    long double avg = ((ld + ld2 + ld3 + ld4 + ld5 + ld6 + ld7 + ld8)/4);
+    long double avg = ((ld + ld2 + ld3 + ld4 + ld5 + ld6 + ld7 + ld8)/8);
     unsigned char retval = (unsigned char) avg;
     if (avg - retval >= 0.5 && retval != 255) {
         ++retval;
     }
     return retval;
 }
+/* Fixed-point versions of the above: the BT.601 coefficients are scaled by 2^FX_SHIFT and rounded so that each row
+ * sums exactly to 2^FX_SHIFT (Y) or to zero (Cb & Cr), so the results never stray more than 1 from the long double
+ * reference. 14 fractional bits are used (rather than 16) so that every coefficient fits in a signed 16-bit integer,
+ * which lets vectorised kernels use the very same constants. */
+#define FX_SHIFT 14
+#define FX_HALF (1 << (FX_SHIFT - 1)) // added before shifting to round to nearest
+#define FX_OFFSET (128 << FX_SHIFT) // +128 chroma offset
+#define FX_Y_R 4899 // 0.299
+#define FX_Y_G 9617 // 0.587
+#define FX_Y_B 1868 // 0.114
+#define FX_CB_R (-2769) // -0.169
+#define FX_CB_G (-5423) // -0.331
+#define FX_CB_B 8192 // 0.500
+#define FX_CR_R 8192 // 0.500
+#define FX_CR_G (-6865) // -0.419
+#define FX_CR_B (-1327) // -0.081
+// the only value a chroma sum can round up to that doesn't fit into a byte is 256 (from 255.5), so this clamps it
+// without a branch:
+#define FX_CLAMP(v) ((unsigned char) ((v) - ((v) >> 8)))
+
+static inline unsigned char get_Y_fx(const colour col) { // Y can't exceed 255.5, which rounds down, so needs no clamp
+    return (unsigned char) ((FX_Y_R*col.r + FX_Y_G*col.g + FX_Y_B*col.b + FX_HALF) >> FX_SHIFT);
+}
+/* the averaging functions first sum the R, G and B values of the colours, which is the same as averaging the Cb/Cr
+ * values (the transformation is linear), and then divide by the number of colours as part of the shift */
+static inline unsigned char get_Cb_fx(const colour col) {
+    int v = (FX_CB_R*col.r + FX_CB_G*col.g + FX_CB_B*col.b + FX_OFFSET + FX_HALF) >> FX_SHIFT;
+    return FX_CLAMP(v);
+}
+
+static inline unsigned char get_Cb_avg2_fx(const colour col, const colour col2) {
+    int v = (FX_CB_R*(col.r + col2.r) + FX_CB_G*(col.g + col2.g) + FX_CB_B*(col.b + col2.b) +
+             2*(FX_OFFSET + FX_HALF)) >> (FX_SHIFT + 1);
+    return FX_CLAMP(v);
+}
+
+static inline unsigned char get_Cb_avg4_fx(const colour col, const colour col2, const colour col3, const colour col4) {
+    int v = (FX_CB_R*(col.r + col2.r + col3.r + col4.r) + FX_CB_G*(col.g + col2.g + col3.g + col4.g) +
+             FX_CB_B*(col.b + col2.b + col3.b + col4.b) + 4*(FX_OFFSET + FX_HALF)) >> (FX_SHIFT + 2);
+    return FX_CLAMP(v);
+}
+
+static inline unsigned char get_Cb_avg8_fx(const colour col, const colour col2, const colour col3, const colour col4,
+                                           const colour col5, const colour col6, const colour col7, const colour col8){
+    int v = (FX_CB_R*(col.r + col2.r + col3.r + col4.r + col5.r + col6.r + col7.r + col8.r) +
+             FX_CB_G*(col.g + col2.g + col3.g + col4.g + col5.g + col6.g + col7.g + col8.g) +
+             FX_CB_B*(col.b + col2.b + col3.b + col4.b + col5.b + col6.b + col7.b + col8.b) +
+             8*(FX_OFFSET + FX_HALF)) >> (FX_SHIFT + 3);
+    return FX_CLAMP(v);
+}
+
+static inline unsigned char get_Cr_fx(const colour col) {
+    int v = (FX_CR_R*col.r + FX_CR_G*col.g + FX_CR_B*col.b + FX_OFFSET + FX_HALF) >> FX_SHIFT;
+    return FX_CLAMP(v);
+}
+
+static inline unsigned char get_Cr_avg2_fx(const colour col, const colour col2) {
+    int v = (FX_CR_R*(col.r + col2.r) + FX_CR_G*(col.g + col2.g) + FX_CR_B*(col.b + col2.b) +
+             2*(FX_OFFSET + FX_HALF)) >> (FX_SHIFT + 1);
+    return FX_CLAMP(v);
+}
+
+static inline unsigned char get_Cr_avg4_fx(const colour col, const colour col2, const colour col3, const colour col4) {
+    int v = (FX_CR_R*(col.r + col2.r + col3.r + col4.r) + FX_CR_G*(col.g + col2.g + col3.g + col4.g) +
+             FX_CR_B*(col.b + col2.b + col3.b + col4.b) + 4*(FX_OFFSET + FX_HALF)) >> (FX_SHIFT + 2);
+    return FX_CLAMP(v);
+}
+
+static inline unsigned char get_Cr_avg8_fx(const colour col, const colour col2, const colour col3, const colour col4,
+                                           const colour col5, const colour col6, const colour col7, const colour col8){
+    int v = (FX_CR_R*(col.r + col2.r + col3.r + col4.r + col5.r + col6.r + col7.r + col8.r) +
+             FX_CR_G*(col.g + col2.g + col3.g + col4.g + col5.g + col6.g + col7.g + col8.g) +
+             FX_CR_B*(col.b + col2.b + col3.b + col4.b + col5.b + col6.b + col7.b + col8.b) +
+             8*(FX_OFFSET + FX_HALF)) >> (FX_SHIFT + 3);
+    return FX_CLAMP(v);
+}
 
 static inline void print_colour(const colour *col) {
     if (!col) {
@@ -321,7 +403,8 @@ long long to_ll(const char *str, const char **end_char) {
         ret += *str++ - 48;
         ++count;
     }
-    *end_char = str;
+    if (end_char)
+        *end_char = str;
     return negative ? -ret : ret;
 }
 
@@ -351,6 +434,11 @@ static inline bool equal(const char *str1, const char *str2) { // convenience fu
     return strcmp_c(str1, str2) == 0;
 }
 
+static inline bool equal_n(const char *str1, const char *str2, size_t n) { // whether the first n chars are the same
+    for (; n && *str1 == *str2; --n, ++str1, ++str2);
+    return !n;
+}
+
 static inline bool startswith_c(const char *str1, char c) {
     return str1 && *str1 == c;
 }
@@ -365,35 +453,52 @@ bool startswith(const char *str, const char *substr) {
     return *substr == 0; // in case substr was longer than str
 }
 
+static inline char lower_c(char c) {
+    return c >= 'A' && c <= 'Z' ? (char) (c + 32) : c;
+}
+
 int alfcmp_c(const char *restrict str1, const char *str2) { // treats upper and lower-case letters equally
     if (!str1 || !str2) {
         return -128;
     }
+    while (*str1 && lower_c(*str1) == lower_c(*str2)) {
+        ++str1;
+        ++str2;
+    }
+    return lower_c(*str1) - lower_c(*str2);
+}
+
+int natcmp_c(const char *str1, const char *str2) { // like alfcmp_c, but compares runs of digits by their value
+    if (!str1 || !str2) {
+        return -128;
+    }
+    const char *beg1 = str1;
+    const char *beg2 = str2;
+    const char *end1;
+    const char *end2;
     while (*str1 && *str2) {
-        if (*str1 != *str2) {
-            if (*str1 >= 65 && *str1 <= 90) {
-                if (*str2 - *str1 == 32) {
-                    goto inc;
-                }
-                if (*str2 >= 97 && *str2 <= 122) {
-                    return *str1 - *str2 + 32;
-                }
-            }
-            if (*str1 >= 97 && *str1 <= 122) {
-                if (*str1 - *str2 == 32) {
-                    goto inc;
-                }
-                if (*str2 >= 65 && *str2 <= 97) {
-                    return *str1 - *str2 - 32;
-                }
-            }
-            return *str1 - *str2;
+        if (is_digit_c(*str1) && is_digit_c(*str2)) {
+            while (*str1 == '0')
+                ++str1;
+            while (*str2 == '0')
+                ++str2;
+            for (end1 = str1; is_digit_c(*end1); ++end1);
+            for (end2 = str2; is_digit_c(*end2); ++end2);
+            if (end1 - str1 != end2 - str2) // without leading zeros, the longer number is the bigger one
+                return end1 - str1 < end2 - str2 ? -1 : 1;
+            for (; str1 < end1; ++str1, ++str2)
+                if (*str1 != *str2)
+                    return *str1 - *str2;
+            continue;
         }
-        inc:
+        if (lower_c(*str1) != lower_c(*str2))
+            return lower_c(*str1) - lower_c(*str2);
         ++str1;
         ++str2;
     }
-    return *str1 - *str2;
+    if (*str1 || *str2)
+        return lower_c(*str1) - lower_c(*str2);
+    return alfcmp_c(beg1, beg2); // e.g. "7" & "007" have the same value, so are put in alphabetical order instead
 }
 
 char *strcpy_c(char *restrict dst, const char *src) {
@@ -459,30 +564,74 @@ bool endswith(const char *str, const char *suffix) {
     return true;
 }
 
-void alphabetical_sort(const char **array) { // sorts an array of strings alphabetically - must end in NULL
+/* stable bottom-up merge sort of the count strings in array, comparing them from their skip-th character on (tmp must
+ * have room for count pointers) */
+void merge_sort_strs(const char **array, const char **tmp, size_t count, size_t skip,
+                     int (*cmp)(const char *, const char *)) {
+    const char **src = array;
+    const char **dst = tmp;
+    const char **swap;
+    size_t mid;
+    size_t end;
+    size_t i;
+    size_t j;
+    size_t k;
+    for (size_t width = 1; width < count; width *= 2) {
+        for (size_t beg = 0; beg < count; beg += 2*width) { // merge [beg, mid) with [mid, end)
+            mid = beg + width < count ? beg + width : count;
+            end = beg + 2*width < count ? beg + 2*width : count;
+            i = beg;
+            j = mid;
+            k = beg;
+            while (i < mid && j < end)
+                *(dst + k++) = cmp(*(src + i) + skip, *(src + j) + skip) <= 0 ? *(src + i++) : *(src + j++);
+            while (i < mid)
+                *(dst + k++) = *(src + i++);
+            while (j < end)
+                *(dst + k++) = *(src + j++);
+        }
+        swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != array)
+        for (i = 0; i < count; ++i)
+            *(array + i) = *(src + i);
+}
+
+static void sort_strs(const char **array, int (*cmp)(const char *, const char *)) { // array must end in NULL
     if (!array || !*array || !*(array + 1))
         return;
-    const char *temp;
-    bool sorted = false;
-    int comp;
-    const char **prev;
-    const char **arr;
-    while (!sorted) {
-        arr = array;
-        prev = arr++;
-        sorted = true;
-        while (*arr) {
-            comp = alfcmp_c(*prev, *arr);
-            if (comp > 0) {
-                sorted = false;
-                temp = *prev;
-                *prev = *arr;
-                *arr = temp;
+    size_t count = 0;
+    size_t skip = strlen_c(*array);
+    const char *first = *array;
+    const char *str;
+    for (const char **ptr = array; *ptr; ++ptr, ++count) { // all paths usually share the directory, so skip it
+        str = *ptr;
+        for (size_t i = 0; i < skip; ++i) {
+            if (*(str + i) != *(first + i)) {
+                skip = i;
+                break;
             }
-            ++prev;
-            ++arr;
         }
     }
+    while (skip && is_digit_c(*(first + skip - 1))) // natcmp_c has to see the whole of a number
+        --skip;
+    const char **tmp = malloc(count*sizeof(const char *));
+    if (!tmp) {
+        fprintf(stderr, "Memory allocation error when sorting the BMP paths.\n");
+        abort();
+    }
+    merge_sort_strs(array, tmp, count, skip, cmp);
+    free(tmp);
+}
+
+void alphabetical_sort(const char **array) { // sorts an array of strings alphabetically - must end in NULL
+    sort_strs(array, alfcmp_c);
+}
+
+void natural_sort(const char **array) { // same as above, but with e.g. "frame_2.bmp" before "frame_10.bmp"
+    sort_strs(array, natcmp_c);
 }
 
 void print_array(const char *const *array) { // must end in NULL
@@ -544,6 +693,21 @@ const char *get_und_time(void) {
     return org;
 }
 
+unsigned long long get_time_ns(void) { // monotonic time in nanoseconds, for measuring how long things take
+#ifdef _WIN32
+    LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (unsigned long long) (count.QuadPart/freq.QuadPart)*1000000000ull +
+           (unsigned long long) (count.QuadPart % freq.QuadPart)*1000000000ull/freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec*1000000000ull + (unsigned long long) ts.tv_nsec;
+#endif
+}
+
 char *append_integer(char *str, long long num) {
     if (!str) {
         return str;
@@ -633,24 +797,26 @@ const char *yuv_header(unsigned short width, unsigned short height, long long fr
     return str;
 }
 
-static inline void check_dim(FILE *fp, const char *str) {
-    static unsigned int expected_width = 0;
-    static unsigned int expected_height;
-    static unsigned int width;
-    static unsigned int height;
-    if (expected_width == 0) {
-        fseek(fp, 18, SEEK_SET);
-        fread(&expected_width, sizeof(unsigned int), 1, fp);
-        fread(&expected_height, sizeof(unsigned int), 1, fp);
-        return;
+/* validates the headers at the start of a BMP of the given size against those of the first BMP, returning the offset of
+ * its pixel array (which must hold expected_height rows of row_size bytes, the padding of the last one aside) */
+static inline size_t check_bmp(const unsigned char *data, size_t size, const char *str, unsigned int expected_width,
+                               unsigned int expected_height, size_t row_size) {
+    if (size < sizeof(bmp_header) + sizeof(bmp_info_header)) {
+        fprintf(stderr, "BMP image \"%s\" is too small to be a valid BMP.\n", str);
+        abort();
     }
-    fseek(fp, 18, SEEK_SET);
-    fread(&width, sizeof(unsigned int), 1, fp);
-    fread(&height, sizeof(unsigned int), 1, fp);
-    if (width != expected_width || height != expected_height) {
+    const bmp_header *hdr = (const bmp_header *) data; // both structs are packed, so can be read straight from data
+    const bmp_info_header *info_hdr = (const bmp_info_header *) (data + sizeof(bmp_header));
+    if (info_hdr->bmp_width != expected_width || info_hdr->bmp_height != expected_height) {
         fprintf(stderr, "The dimensions of BMP image \"%s\" do not match that of the first BMP.\n", str);
         abort();
     }
+    if (hdr->px_arr_offset > size ||
+        size - hdr->px_arr_offset < (expected_height - 1)*row_size + expected_width*sizeof(colour)) {
+        fprintf(stderr, "BMP image \"%s\" is truncated.\n", str);
+        abort();
+    }
+    return hdr->px_arr_offset;
 }
 
 void for_each(void *arr, size_t element_size, size_t count, void (*func)(void*)) {
@@ -672,129 +838,290 @@ void to_ycbcr(void *bgr) {
     col->g = Cb;
 }
 
-void output_444(const colour *input, unsigned char *output, size_t num_pixels){
-    static const colour *ptr;
-    static size_t i;
-    ptr = input;
-    for (i = 0; i < num_pixels; ++i, ++ptr) {
-        *output++ = get_Y(*ptr);
-    }
-    ptr = input;
-    for (i = 0; i < num_pixels; ++i, ++ptr) {
-        *output++ = get_Cb(*ptr);
-    }
-    for (i = 0; i < num_pixels; ++i, ++input) {
-        *output++ = get_Cr(*input);
-    }
-}
-
-void output_422(const colour *input, unsigned char *output, size_t num_pixels){
-    static const colour *ptr;
-    static size_t i;
-    static size_t half;
-    half = num_pixels/2; // num_pixels is guaranteed to be even
-    ptr = input;
-    for (i = 0; i < num_pixels; ++i, ++ptr) {
-        *output++ = get_Y(*ptr);
-    }
-    ptr = input;
-    for (i = 0; i < half; ++i, ptr += 2) {
-        *output++ = get_Cb_avg2(*ptr, *(ptr + 1));
-    }
-    for (i = 0; i < half; ++i, input += 2) {
-        *output++ = get_Cr_avg2(*input, *(input + 1));
-    }
-}
-
-void output_420(const colour *input, unsigned char *output, unsigned int width, unsigned int height){
-    static const colour *ptr;
-    static const colour *nxt;
-    static unsigned int half_w;
-    static unsigned int half_h;
-    static unsigned int num_pixels;
-    static unsigned int j;
-    static unsigned int i;
-    num_pixels = width*height;
-    half_w = width/2; // both width and height are guaranteed to be divisible by 2
-    half_h = height/2;
-    ptr = input;
-    for (i = 0; i < num_pixels; ++i, ++ptr) {
-        *output++ = get_Y(*ptr);
-    }
-    ptr = input;
-    nxt = input + width; // points to row "below" ptr
-    for (j = 0; j < half_h; ++j) {
-        for (i = 0; i < half_w; ++i, ptr += 2, nxt += 2) {
-            *output++ = get_Cb_avg4(*ptr, *(ptr + 1), *nxt, *(nxt + 1));
-        }
-        ptr += width;
-        nxt += width;
-    }
-    ptr = input;
-    nxt = input + width;
-    for (j = 0; j < half_h; ++j) {
-        for (i = 0; i < half_w; ++i, ptr += 2, nxt += 2) {
-            *output++ = get_Cr_avg4(*ptr, *(ptr + 1), *nxt, *(nxt + 1));
+// stride is in bytes, as the rows of BMPs are padded to multiples of 4 bytes
+static inline const colour *next_row(const colour *row, ptrdiff_t stride) {
+    return (const colour *) ((const unsigned char *) row + stride);
+}
+
+/* reference kernels, using the long double functions - kept for validating the fixed-point ones against. Like the
+ * fixed-point ones, they convert each block of pixels sharing a Cb & Cr value in one go, writing all three planes in
+ * a single pass over the frame */
+void output_444_ref(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                    unsigned char *cr, unsigned int width, unsigned int height) {
+    const colour *ptr;
+    unsigned int j;
+    unsigned int i;
+    for (j = 0; j < height; ++j, input = next_row(input, stride)) {
+        ptr = input;
+        for (i = 0; i < width; ++i, ++ptr) {
+            *luma++ = get_Y(*ptr);
+            *cb++ = get_Cb(*ptr);
+            *cr++ = get_Cr(*ptr);
         }
-        ptr += width;
-        nxt += width;
     }
 }
 
-void output_411(const colour *input, unsigned char *output, size_t num_pixels){
-    static const colour *ptr;
-    static size_t i;
-    static size_t quarter;
-    quarter = num_pixels/4; // num_pixels is guaranteed to be divisible by 4
-    ptr = input;
-    for (i = 0; i < num_pixels; ++i, ++ptr) {
-        *output++ = get_Y(*ptr);
+void output_422_ref(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                    unsigned char *cr, unsigned int width, unsigned int height) {
+    const colour *ptr;
+    unsigned int j;
+    unsigned int i;
+    for (j = 0; j < height; ++j, input = next_row(input, stride)) {
+        ptr = input;
+        for (i = 0; i < width; i += 2, ptr += 2) { // width is guaranteed to be even
+            *luma++ = get_Y(*ptr);
+            *luma++ = get_Y(*(ptr + 1));
+            *cb++ = get_Cb_avg2(*ptr, *(ptr + 1));
+            *cr++ = get_Cr_avg2(*ptr, *(ptr + 1));
+        }
     }
-    ptr = input;
-    for (i = 0; i < quarter; ++i, ptr += 4) {
-        *output++ = get_Cb_avg4(*ptr, *(ptr + 1), *(ptr + 2), *(ptr + 3));
+}
+
+void output_420_ref(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                    unsigned char *cr, unsigned int width, unsigned int height) {
+    const colour *ptr;
+    const colour *nxt;
+    unsigned char *y2;
+    unsigned int j;
+    unsigned int i;
+    for (j = 0; j < height; j += 2, input = next_row(input, 2*stride), luma = y2) { // width & height are both even
+        ptr = input;
+        nxt = next_row(input, stride); // points to row "below" ptr
+        y2 = luma + width;
+        for (i = 0; i < width; i += 2, ptr += 2, nxt += 2) {
+            *luma++ = get_Y(*ptr);
+            *luma++ = get_Y(*(ptr + 1));
+            *y2++ = get_Y(*nxt);
+            *y2++ = get_Y(*(nxt + 1));
+            *cb++ = get_Cb_avg4(*ptr, *(ptr + 1), *nxt, *(nxt + 1));
+            *cr++ = get_Cr_avg4(*ptr, *(ptr + 1), *nxt, *(nxt + 1));
+        }
     }
-    for (i = 0; i < quarter; ++i, input += 4) {
-        *output++ = get_Cr_avg4(*input, *(input + 1), *(input + 2), *(input + 3));
+}
+
+void output_411_ref(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                    unsigned char *cr, unsigned int width, unsigned int height) {
+    const colour *ptr;
+    unsigned int j;
+    unsigned int i;
+    for (j = 0; j < height; ++j, input = next_row(input, stride)) {
+        ptr = input;
+        for (i = 0; i < width; i += 4, ptr += 4) { // width is guaranteed to be divisible by 4
+            *luma++ = get_Y(*ptr);
+            *luma++ = get_Y(*(ptr + 1));
+            *luma++ = get_Y(*(ptr + 2));
+            *luma++ = get_Y(*(ptr + 3));
+            *cb++ = get_Cb_avg4(*ptr, *(ptr + 1), *(ptr + 2), *(ptr + 3));
+            *cr++ = get_Cr_avg4(*ptr, *(ptr + 1), *(ptr + 2), *(ptr + 3));
+        }
     }
 }
 
 /* 4:1:0 is not a good format - it has little support; not even VLC and ffmpeg can deal with it */
-void output_410(const colour *input, unsigned char *output, unsigned int width, unsigned int height){
-    static const colour *ptr;
-    static const colour *nxt;
-    static unsigned int quarter_w;
-    static unsigned int half_h;
-    static unsigned int num_pixels;
-    static unsigned int j;
-    static unsigned int i;
-    num_pixels = width*height;
-    quarter_w = width/4; // width will be divisible by 4
-    half_h = height/2; // height will be divisible by 2
-    ptr = input;
-    for (i = 0; i < num_pixels; ++i, ++ptr) {
-        *output++ = get_Y(*ptr);
-    }
-    ptr = input;
-    nxt = input + width; // points to row "below" ptr
-    for (j = 0; j < half_h; ++j) {
-        for (i = 0; i < quarter_w; ++i, ptr += 4, nxt += 4) {
-            *output++ = get_Cb_avg8(*ptr, *(ptr + 1), *(ptr + 2), *(ptr + 3), *nxt, *(nxt + 1), *(nxt + 2), *(nxt + 3));
+void output_410_ref(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                    unsigned char *cr, unsigned int width, unsigned int height) {
+    const colour *ptr;
+    const colour *nxt;
+    unsigned char *y2;
+    unsigned int j;
+    unsigned int i;
+    unsigned int k;
+    for (j = 0; j < height; j += 2, input = next_row(input, 2*stride), luma = y2) { // height will be even
+        ptr = input;
+        nxt = next_row(input, stride);
+        y2 = luma + width;
+        for (i = 0; i < width; i += 4, ptr += 4, nxt += 4) { // width will be divisible by 4
+            for (k = 0; k < 4; ++k) {
+                *luma++ = get_Y(*(ptr + k));
+                *y2++ = get_Y(*(nxt + k));
+            }
+            *cb++ = get_Cb_avg8(*ptr, *(ptr + 1), *(ptr + 2), *(ptr + 3), *nxt, *(nxt + 1), *(nxt + 2), *(nxt + 3));
+            *cr++ = get_Cr_avg8(*ptr, *(ptr + 1), *(ptr + 2), *(ptr + 3), *nxt, *(nxt + 1), *(nxt + 2), *(nxt + 3));
+        }
+    }
+}
+
+/* Cb & Cr of the average of 2^k colours, given the sums of their R, G and B values, which the fixed-point kernels
+ * compute once per block rather than once for each of Cb & Cr. Gives exactly the same results as the _avg functions */
+static inline void put_CbCr_fx(unsigned char *cb, unsigned char *cr, int r, int g, int b, int k) {
+    int v = (FX_CB_R*r + FX_CB_G*g + FX_CB_B*b + ((FX_OFFSET + FX_HALF) << k)) >> (FX_SHIFT + k);
+    *cb = FX_CLAMP(v);
+    v = (FX_CR_R*r + FX_CR_G*g + FX_CR_B*b + ((FX_OFFSET + FX_HALF) << k)) >> (FX_SHIFT + k);
+    *cr = FX_CLAMP(v);
+}
+
+void output_444(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                unsigned char *cr, unsigned int width, unsigned int height) {
+    const colour *ptr;
+    unsigned int j;
+    unsigned int i;
+    for (j = 0; j < height; ++j, input = next_row(input, stride)) {
+        ptr = input;
+        for (i = 0; i < width; ++i, ++ptr) {
+            *luma++ = get_Y_fx(*ptr);
+            put_CbCr_fx(cb++, cr++, ptr->r, ptr->g, ptr->b, 0);
+        }
+    }
+}
+
+void output_422(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                unsigned char *cr, unsigned int width, unsigned int height) {
+    const colour *ptr;
+    unsigned int j;
+    unsigned int i;
+    for (j = 0; j < height; ++j, input = next_row(input, stride)) {
+        ptr = input;
+        for (i = 0; i < width; i += 2, ptr += 2) { // width is guaranteed to be even
+            *luma++ = get_Y_fx(*ptr);
+            *luma++ = get_Y_fx(*(ptr + 1));
+            put_CbCr_fx(cb++, cr++, ptr->r + (ptr + 1)->r, ptr->g + (ptr + 1)->g, ptr->b + (ptr + 1)->b, 1);
+        }
+    }
+}
+
+void output_420(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                unsigned char *cr, unsigned int width, unsigned int height) {
+    const colour *ptr;
+    const colour *nxt;
+    unsigned char *y2;
+    unsigned int j;
+    unsigned int i;
+    for (j = 0; j < height; j += 2, input = next_row(input, 2*stride), luma = y2) { // width & height are both even
+        ptr = input;
+        nxt = next_row(input, stride); // points to row "below" ptr
+        y2 = luma + width;
+        for (i = 0; i < width; i += 2, ptr += 2, nxt += 2) { // one 2x2 block at a time
+            *luma++ = get_Y_fx(*ptr);
+            *luma++ = get_Y_fx(*(ptr + 1));
+            *y2++ = get_Y_fx(*nxt);
+            *y2++ = get_Y_fx(*(nxt + 1));
+            put_CbCr_fx(cb++, cr++, ptr->r + (ptr + 1)->r + nxt->r + (nxt + 1)->r,
+                        ptr->g + (ptr + 1)->g + nxt->g + (nxt + 1)->g,
+                        ptr->b + (ptr + 1)->b + nxt->b + (nxt + 1)->b, 2);
+        }
+    }
+}
+
+void output_411(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                unsigned char *cr, unsigned int width, unsigned int height) {
+    const colour *ptr;
+    unsigned int j;
+    unsigned int i;
+    unsigned int k;
+    int r, g, b;
+    for (j = 0; j < height; ++j, input = next_row(input, stride)) {
+        ptr = input;
+        for (i = 0; i < width; i += 4, ptr += 4) { // width is guaranteed to be divisible by 4
+            r = g = b = 0;
+            for (k = 0; k < 4; ++k) {
+                *luma++ = get_Y_fx(*(ptr + k));
+                r += (ptr + k)->r;
+                g += (ptr + k)->g;
+                b += (ptr + k)->b;
+            }
+            put_CbCr_fx(cb++, cr++, r, g, b, 2);
         }
-        ptr += width;
-        nxt += width;
-    }
-    ptr = input;
-    nxt = input + width;
-    for (j = 0; j < half_h; ++j) {
-        for (i = 0; i < quarter_w; ++i, ptr += 4, nxt += 4) {
-            *output++ = get_Cr_avg8(*ptr, *(ptr + 1), *(ptr + 2), *(ptr + 3), *nxt, *(nxt + 1), *(nxt + 2), *(nxt + 3));
+    }
+}
+
+void output_410(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                unsigned char *cr, unsigned int width, unsigned int height) {
+    const colour *ptr;
+    const colour *nxt;
+    unsigned char *y2;
+    unsigned int j;
+    unsigned int i;
+    unsigned int k;
+    int r, g, b;
+    for (j = 0; j < height; j += 2, input = next_row(input, 2*stride), luma = y2) { // height will be even
+        ptr = input;
+        nxt = next_row(input, stride);
+        y2 = luma + width;
+        for (i = 0; i < width; i += 4, ptr += 4, nxt += 4) { // one 4x2 block at a time (width is divisible by 4)
+            r = g = b = 0;
+            for (k = 0; k < 4; ++k) {
+                *luma++ = get_Y_fx(*(ptr + k));
+                *y2++ = get_Y_fx(*(nxt + k));
+                r += (ptr + k)->r + (nxt + k)->r;
+                g += (ptr + k)->g + (nxt + k)->g;
+                b += (ptr + k)->b + (nxt + k)->b;
+            }
+            put_CbCr_fx(cb++, cr++, r, g, b, 3);
         }
-        ptr += width;
-        nxt += width;
     }
 }
 
+typedef enum {
+    CONV_AUTO, CONV_FIXED, CONV_REF, CONV_SSE2, CONV_AVX2, CONV_AVX512, CONV_LUT
+} conv_backend; // which implementation of the colour transforms is used for the conversion (auto: fastest available)
+
+/* all the kernels take the 3 planes separately, so that parts of a frame can be converted straight into place, and
+ * walk the input rows "stride" bytes apart (negative when going through a BMP's pixel array in y4m row order) */
+typedef void (*conv_kernel)(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                            unsigned char *cr, unsigned int width, unsigned int height);
+
+#define TILE_SIZE 16 // side of the tiles compared between frames with "-incr", a multiple of every sub-sampling factor
+
+// flags each tile (of TILE_SIZE pixels) of a row, bytes long, in which rows a & b differ - flags already set are kept
+typedef void (*diff_kernel)(const unsigned char *a, const unsigned char *b, size_t bytes, unsigned char *dirty);
+
+static inline unsigned long long load_u64(const unsigned char *ptr) { // compilers turn this into a single load
+    return (unsigned long long) *ptr | (unsigned long long) *(ptr + 1) << 8 | (unsigned long long) *(ptr + 2) << 16 |
+           (unsigned long long) *(ptr + 3) << 24 | (unsigned long long) *(ptr + 4) << 32 |
+           (unsigned long long) *(ptr + 5) << 40 | (unsigned long long) *(ptr + 6) << 48 |
+           (unsigned long long) *(ptr + 7) << 56;
+}
+
+void diff_tiles(const unsigned char *a, const unsigned char *b, size_t bytes, unsigned char *dirty) {
+    size_t end;
+    unsigned long long diff;
+    for (size_t x = 0; x < bytes; x = end, ++dirty) {
+        end = bytes - x < TILE_SIZE*sizeof(colour) ? bytes : x + TILE_SIZE*sizeof(colour);
+        if (*dirty) // no need to look any further
+            continue;
+        for (diff = 0; x + 8 <= end; x += 8) // no early exit, so that the words of a tile are compared all at once
+            diff |= load_u64(a + x) ^ load_u64(b + x);
+        for (; x < end; ++x)
+            diff |= *(a + x) ^ *(b + x);
+        *dirty = diff != 0;
+    }
+}
+
+typedef struct { // the colour sub-sampling kernels of one conversion backend
+    conv_kernel out_444;
+    conv_kernel out_422;
+    conv_kernel out_420;
+    conv_kernel out_411;
+    conv_kernel out_410;
+    diff_kernel diff; // for "-incr"
+} conv_kernels;
+
+static const conv_kernels fixed_kernels = {output_444, output_422, output_420, output_411, output_410, diff_tiles};
+static const conv_kernels ref_kernels = {output_444_ref, output_422_ref, output_420_ref, output_411_ref,
+                                         output_410_ref, diff_tiles};
+
+volatile sig_atomic_t stop_requested = 0; // set once SIGINT is received, for the conversion to stop early
+
+void stop_handler(int sig) { // must only touch stop_requested, being called asynchronously
+    (void) sig;
+    stop_requested = 1;
+}
+
+/* has the first SIGINT call stop_handler() - a second one kills the process as usual, should the conversion not stop.
+ * System calls aren't restarted after it, so that a thread waiting for the next BMP of a stream (which is the only one
+ * SIGINT is delivered to then - see run_pipeline()) stops waiting */
+void install_stop_handler(void) {
+#ifdef _WIN32
+    signal(SIGINT, stop_handler); // the handler is reset to the default before being called anyway
+#else
+    struct sigaction action = {0};
+    action.sa_handler = stop_handler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESETHAND;
+    sigaction(SIGINT, &action, NULL);
+#endif
+}
+
 static inline void start_frame(FILE *fp) {
     // static const char frame[] = {'F', 'R', 'A', 'M', 'E', '\n'};
     // fwrite(frame, sizeof(char), 6, fp);
@@ -904,39 +1231,150 @@ _Noreturn void log_floating_error(const char *str, int pos) {
     abort();
 }
 
-void process_argv(int argc, char **argv, bool *del, bool *timed, bool *sized, bool *prog, const char **path_to_vid,
-                  const char **path_to_folder, long long *rate_num, long long *rate_denom, const char **subsampling) {
+#define DEF_DEDUP_CACHE 4 // number of distinct frames "-dedup" keeps for reuse, unless given with "-dedup=<num>"
+#define DEF_PROG_RATE 4 // times a second "-p" refreshes the progress on a terminal, unless given by "-prog-rate=<num>"
+
+typedef enum {
+    STATS_NONE, STATS_TEXT, STATS_JSON
+} stats_format; // how the per-stage timings are printed at the end ("-stats" -> text, "-stats=json" -> JSON)
+
+typedef struct { // all the settings that can be changed through the command-line
+    bool del; // whether to delete .bmp images as they are appended to the video
+    bool timed; // whether to display the time taken for the video generation
+    bool sized; // whether to display the total file size of the video generated
+    bool prog; // whether to show the progress of the video generation
+    unsigned int prog_rate; // max. number of times a second the progress is refreshed on a terminal
+    const char *vid_path; // path to the .y4m as given by the user - remains NULL if none given
+    const char *folder_path; // path to directory containing .bmp files - if none given, cwd is used
+    long long rate_num; // frame rate numerator
+    long long rate_denom; // frame rate denominator
+    const char *subsampling; // colour sub-sampling ("444", "422", "420", "411" or "410")
+    conv_backend backend;
+    unsigned int jobs; // number of converter threads (0 -> one per CPU)
+    unsigned int readers; // number of reader threads
+    unsigned int queue_depth; // max. number of frames in memory at once (0 -> enough to keep all threads busy)
+    unsigned int stripes; // number of stripes each frame is split into for conversion (0 -> decided automatically)
+    bool stream; // whether to convert frames a few rows at a time, on one thread, with memory use independent of height
+    bool natural; // whether to sort the BMPs in natural order ("frame_2.bmp" before "frame_10.bmp") or alphabetically
+    const char *list_path; // file listing the BMPs to convert, in order ("-" for stdin) - NULL to scan folder_path
+    const char *in_path; // pipe, FIFO or file holding the BMPs themselves, one after another ("-" for stdin)
+    bool watch; // whether to keep converting BMPs as they appear in folder_path, until the render is finished
+    const char *sentinel; // name of the file that marks the end of the render when watching (NULL -> DEF_SENTINEL)
+    unsigned int watch_timeout; // seconds without a new BMP after which watching ends (0 -> DEF_WATCH_TIMEOUT)
+    bool resume; // whether to carry on writing vid_path (if it exists), & keep checkpoints to resume it from
+    unsigned int dedup; // number of distinct converted frames kept for reusing for duplicate frames (0 -> none)
+    bool incremental; // whether to only convert the tiles of each frame that differ from the frame before
+    stats_format stats;
+    const char *trace_path; // file the timeline of the conversion is written to, for chrome://tracing (NULL -> none)
+    bool dry_run; // whether to only print the size of the video & how long it would take, without writing it
+    unsigned int sync_every; // with "-d": frames between syncs of the video, which BMPs are deleted after (0 -> none)
+} options;
+
+unsigned int parse_count(const char *arg, size_t prefix_len) { // parses the <num> in options of the form "-opt=<num>"
+    const char *end_char;
+    long long val = to_ll(arg + prefix_len, &end_char);
+    if (end_char == arg + prefix_len || *end_char != 0) {
+        fprintf(stderr, BOLD_TXT(RED_TXT("Error:")) UNDERLINED_TXT(BLUE_TXT(" non-numeric characters were passed in"))
+                        YELLOW_TXT(" \"%s\" ") UNDERLINED_TXT(BLUE_TXT("argument:\n")), arg);
+        log_non_numeric_error(arg + prefix_len);
+    }
+    if (val <= 0 || val > 0xffffffffll) {
+        fprintf(stderr, BOLD_TXT(RED_TXT("Error:")) UNDERLINED_TXT(BLUE_TXT(" value passed in"))
+                        YELLOW_TXT(" \"%s\" ") UNDERLINED_TXT(BLUE_TXT("must be a positive integer.\n")), arg);
+        abort();
+    }
+    return (unsigned int) val;
+}
+
+static void check_file_arg(const char *opt, unsigned int i, int argc) { // for options followed by a file, e.g. "-o"
+    if (i + 1 < (unsigned int) argc)
+        return;
+    fprintf(stderr, BOLD_TXT(RED_TXT("Error:")) UNDERLINED_TXT(BLUE_TXT(" no file specified after the"))
+                    YELLOW_TXT(" \"%s\" ") UNDERLINED_TXT(BLUE_TXT(" option.\n")), opt);
+    abort();
+}
+
+void process_argv(int argc, char **argv, options *opts) {
     static char sub[] = "420";
-    *del = false;
-    *timed = false;
-    *sized = false;
-    *prog = false;
-    *path_to_vid = NULL;
-    *path_to_folder = NULL;
-    *rate_num = 30;
-    *rate_denom = 1;
-    *subsampling = sub;
+    opts->del = false;
+    opts->timed = false;
+    opts->sized = false;
+    opts->prog = false;
+    opts->prog_rate = DEF_PROG_RATE;
+    opts->vid_path = NULL;
+    opts->folder_path = NULL;
+    opts->rate_num = 30;
+    opts->rate_denom = 1;
+    opts->subsampling = sub;
+    opts->backend = CONV_AUTO;
+    opts->jobs = 0;
+    opts->readers = 2;
+    opts->queue_depth = 0;
+    opts->stripes = 0;
+    opts->stream = false;
+    opts->natural = false;
+    opts->list_path = NULL;
+    opts->in_path = NULL;
+    opts->watch = false;
+    opts->sentinel = NULL;
+    opts->watch_timeout = 0;
+    opts->resume = false;
+    opts->dedup = 0;
+    opts->incremental = false;
+    opts->stats = STATS_NONE;
+    opts->trace_path = NULL;
+    opts->dry_run = false;
+    opts->sync_every = 0;
     if (argc == 1) {
-        *path_to_folder = get_cur_dir();
+        opts->folder_path = get_cur_dir();
         return;
     }
     ++argv;
     bool have_path = false;
+    bool have_list = false;
+    bool have_in = false;
+    bool have_trace = false;
     for (unsigned int i = 1; i < argc; ++i, ++argv) {
         if (have_path) {
-            *path_to_vid = *argv;
+            opts->vid_path = *argv;
             have_path = false;
             continue;
         }
+        if (have_list) {
+            opts->list_path = *argv;
+            have_list = false;
+            continue;
+        }
+        if (have_in) {
+            opts->in_path = *argv;
+            have_in = false;
+            continue;
+        }
+        if (have_trace) {
+            opts->trace_path = *argv;
+            have_trace = false;
+            continue;
+        }
         if (equal(*argv, "-o")) {
-            if (i == argc - 1) {
-                fprintf(stderr, BOLD_TXT(RED_TXT("Error:")) UNDERLINED_TXT(BLUE_TXT(" no file specified after the"))
-                                YELLOW_TXT(" \"-o\" ") UNDERLINED_TXT(BLUE_TXT(" option.\n")));
-                abort();
-            }
+            check_file_arg(*argv, i, argc);
             have_path = true;
             continue;
         }
+        if (equal(*argv, "-list")) {
+            check_file_arg(*argv, i, argc);
+            have_list = true;
+            continue;
+        }
+        if (equal(*argv, "-in")) {
+            check_file_arg(*argv, i, argc);
+            have_in = true;
+            continue;
+        }
+        if (equal(*argv, "-trace")) {
+            check_file_arg(*argv, i, argc);
+            have_trace = true;
+            continue;
+        }
         if (startswith_c(*argv, '-')) {
             if (*(*argv + 1) == 0) {
                 fprintf(stderr, BOLD_TXT(RED_TXT("Error:")) UNDERLINED_TXT(BLUE_TXT(" invalid option specified:"))
@@ -979,7 +1417,7 @@ void process_argv(int argc, char **argv, bool *del, bool *timed, bool *sized, bo
                     abort();
                 }
                 const char *end_char;
-                *rate_num = to_ll(*argv + 5, &end_char);
+                opts->rate_num = to_ll(*argv + 5, &end_char);
                 if (end_char == *argv + 5 || (*end_char != 0 && *end_char != '/')) {
                     fprintf(stderr, BOLD_TXT(RED_TXT("Error:"))
                                     UNDERLINED_TXT(BLUE_TXT(" non-numeric characters were passed in the first "))
@@ -1002,7 +1440,7 @@ void process_argv(int argc, char **argv, bool *del, bool *timed, bool *sized, bo
                         log_floating_error("Expected value", char_count - 2);
                     }
                     const char *second_end;
-                    *rate_denom = to_ll(end_char + 1, &second_end);
+                    opts->rate_denom = to_ll(end_char + 1, &second_end);
                     if (end_char + 1 == second_end || *second_end != 0) {
                         fprintf(stderr, BOLD_TXT(RED_TXT("Error:"))
                                         UNDERLINED_TXT(BLUE_TXT(" non-numeric characters were passed in the second "))
@@ -1013,24 +1451,24 @@ void process_argv(int argc, char **argv, bool *del, bool *timed, bool *sized, bo
                         print_nonnum_fps(*argv);
                     }
                 }
-                if (!*rate_num || rate_num < 0) {
+                if (!opts->rate_num || opts->rate_num < 0) {
                     fprintf(stderr,
                             BOLD_TXT(RED_TXT("Error:"))
                             UNDERLINED_TXT(BLUE_TXT(" frame rate numerator determined to be zero or negative:"))
                             GREEN_TXT(" %lld ")
                             UNDERLINED_TXT(BLUE_TXT("\nDo not enter a value less than or equal to zero,"))
                             UNDERLINED_TXT(BLUE_TXT(" or greater than \n"))
-                            YELLOW_TXT(" %lld\n"), *rate_num, LL_MAX);
+                            YELLOW_TXT(" %lld\n"), opts->rate_num, LL_MAX);
                     abort();
                 }
-                if (!*rate_denom || rate_denom < 0) {
+                if (!opts->rate_denom || opts->rate_denom < 0) {
                     fprintf(stderr,
                             BOLD_TXT(RED_TXT("Error:"))
                             UNDERLINED_TXT(BLUE_TXT(" frame rate denominator determined to be zero or negative:"))
                             GREEN_TXT(" %lld ")
                             UNDERLINED_TXT(BLUE_TXT("\nDo not enter a value less than or equal to zero,"))
                             UNDERLINED_TXT(BLUE_TXT(" or greater than \n"))
-                            YELLOW_TXT(" %lld\n"), *rate_num, LL_MAX);
+                            YELLOW_TXT(" %lld\n"), opts->rate_num, LL_MAX);
                     abort();
                 }
                 continue;
@@ -1067,22 +1505,139 @@ void process_argv(int argc, char **argv, bool *del, bool *timed, bool *sized, bo
                 strcpy_c(sub, *argv + 5);
                 continue;
             }
+            if (startswith(*argv, "-j=")) {
+                opts->jobs = parse_count(*argv, 3);
+                continue;
+            }
+            if (startswith(*argv, "-readers=")) {
+                opts->readers = parse_count(*argv, 9);
+                continue;
+            }
+            if (startswith(*argv, "-queue=")) {
+                opts->queue_depth = parse_count(*argv, 7);
+                continue;
+            }
+            if (startswith(*argv, "-stripes=")) {
+                opts->stripes = parse_count(*argv, 9);
+                continue;
+            }
+            if (startswith(*argv, "-prog-rate=")) { // must come before the single-letter flags, as it starts with 'p'
+                opts->prog_rate = parse_count(*argv, 11);
+                continue;
+            }
+            if (startswith(*argv, "-sync=")) { // must come before the single-letter flags, as it starts with 's'
+                opts->sync_every = parse_count(*argv, 6);
+                continue;
+            }
+            if (equal(*argv, "-stream")) { // must come before the single-letter flags, as it starts with 's'
+                opts->stream = true;
+                continue;
+            }
+            if (startswith(*argv, "-stats")) { // likewise
+                if (equal(*argv + 6, "") || equal(*argv + 6, "=text")) {
+                    opts->stats = STATS_TEXT;
+                    continue;
+                }
+                if (equal(*argv + 6, "=json")) {
+                    opts->stats = STATS_JSON;
+                    continue;
+                }
+                fprintf(stderr, BOLD_TXT(RED_TXT("Error:")) UNDERLINED_TXT(BLUE_TXT(" invalid statistics format:\n")));
+                fprintf(stderr, "\t\t%s", *argv);
+                log_floating_error("Expected " YELLOW_TXT("\"text\"") BLUE_TXT(" or ") YELLOW_TXT("\"json\"\n"), 7);
+            }
+            if (equal(*argv, "-watch")) {
+#ifdef __linux__
+                opts->watch = true;
+                continue;
+#else
+                fprintf(stderr, BOLD_TXT(RED_TXT("Error:")) YELLOW_TXT(" \"-watch\" ")
+                                UNDERLINED_TXT(BLUE_TXT(" option is only supported on Linux.\n")));
+                abort();
+#endif
+            }
+            if (startswith(*argv, "-sentinel=")) { // must also come before the single-letter flags
+                if (!*(*argv + 10)) {
+                    fprintf(stderr, BOLD_TXT(RED_TXT("Error:")) UNDERLINED_TXT(BLUE_TXT(" no file name given in the"))
+                                    YELLOW_TXT(" \"-sentinel=<name>\" ") UNDERLINED_TXT(BLUE_TXT(" option.\n")));
+                    abort();
+                }
+                opts->sentinel = *argv + 10;
+                continue;
+            }
+            if (equal(*argv, "-dry-run")) { // must also come before the single-letter flags
+                opts->dry_run = true;
+                continue;
+            }
+            if (equal(*argv, "-dedup")) { // must come before the single-letter flags, as it starts with 'd'
+                opts->dedup = DEF_DEDUP_CACHE;
+                continue;
+            }
+            if (startswith(*argv, "-dedup=")) {
+                opts->dedup = parse_count(*argv, 7);
+                continue;
+            }
+            if (equal(*argv, "-incr")) {
+                opts->incremental = true;
+                continue;
+            }
+            if (equal(*argv, "-resume")) {
+                opts->resume = true;
+                continue;
+            }
+            if (startswith(*argv, "-timeout=")) {
+                opts->watch_timeout = parse_count(*argv, 9);
+                continue;
+            }
+            if (startswith(*argv, "-sort=")) {
+                if (equal(*argv + 6, "natural") || equal(*argv + 6, "alpha")) {
+                    opts->natural = *(*argv + 6) == 'n';
+                    continue;
+                }
+                fprintf(stderr, BOLD_TXT(RED_TXT("Error:")) UNDERLINED_TXT(BLUE_TXT(" invalid sort order:\n")));
+                fprintf(stderr, "\t\t%s", *argv);
+                log_floating_error("Expected " YELLOW_TXT("\"natural\"") BLUE_TXT(" or ") YELLOW_TXT("\"alpha\"\n"), 6);
+            }
+            if (startswith(*argv, "-conv")) {
+                static const char *const backends[] = {"=auto", "=fixed", "=ref", "=sse2", "=avx2", "=avx512", "=lut",
+                                                       NULL};
+                const char *const *name = backends;
+                for (; *name; ++name) {
+                    if (equal(*argv + 5, *name)) {
+                        opts->backend = (conv_backend) (name - backends); // same order as the conv_backend enum
+                        break;
+                    }
+                }
+                if (*name) // "-conv=ref" is the slow long double path - only really useful for validation
+                    continue;
+                fprintf(stderr, BOLD_TXT(RED_TXT("Error:"))
+                                UNDERLINED_TXT(BLUE_TXT(" invalid conversion backend:\n")));
+                fprintf(stderr, "\t\t%s", *argv);
+                log_floating_error("Expected "
+                                   YELLOW_TXT("\"auto\"") BLUE_TXT(", ")
+                                   YELLOW_TXT("\"fixed\"") BLUE_TXT(", ")
+                                   YELLOW_TXT("\"ref\"") BLUE_TXT(", ")
+                                   YELLOW_TXT("\"sse2\"") BLUE_TXT(", ")
+                                   YELLOW_TXT("\"avx2\"") BLUE_TXT(", ")
+                                   YELLOW_TXT("\"avx512\"") BLUE_TXT(" or ")
+                                   YELLOW_TXT("\"lut\"\n"), 6);
+            }
             char *ptr = *argv + 1;
             for (size_t count = 1; *ptr; ++count, ++ptr) {
                 if (*ptr == 'd') {
-                    *del = true;
+                    opts->del = true;
                     continue;
                 }
                 if (*ptr == 'p') {
-                    *prog = true;
+                    opts->prog = true;
                     continue;
                 }
                 if (*ptr == 't') {
-                    *timed = true;
+                    opts->timed = true;
                     continue;
                 }
                 if (*ptr == 's') {
-                    *sized = true;
+                    opts->sized = true;
                     continue;
                 }
                 if (*ptr == 'h') {
@@ -1094,8 +1649,52 @@ void process_argv(int argc, char **argv, bool *del, bool *timed, bool *sized, bo
             }
             continue;
         }
-        *path_to_folder = *argv;
+        opts->folder_path = *argv;
+    }
+    if (opts->watch && (opts->in_path || opts->list_path || opts->stream)) { // the BMPs come from folder_path
+        fprintf(stderr, BOLD_TXT(RED_TXT("Error:")) YELLOW_TXT(" \"-watch\" ")
+                        UNDERLINED_TXT(BLUE_TXT(" option cannot be combined with")) YELLOW_TXT(" \"%s\"\n"),
+                        opts->in_path ? "-in" : opts->list_path ? "-list" : "-stream");
+        abort();
+    }
+    if (opts->in_path && (opts->list_path || opts->stream)) { // "-stream" needs to seek within each BMP
+        fprintf(stderr, BOLD_TXT(RED_TXT("Error:")) YELLOW_TXT(" \"-in\" ")
+                        UNDERLINED_TXT(BLUE_TXT(" option cannot be combined with")) YELLOW_TXT(" \"%s\"\n"),
+                        opts->list_path ? "-list" : "-stream");
+        abort();
+    }
+    if (opts->resume && (!opts->vid_path || equal(opts->vid_path, "-"))) { // the default path is new every run
+        fprintf(stderr, BOLD_TXT(RED_TXT("Error:")) YELLOW_TXT(" \"-resume\" ")
+                        UNDERLINED_TXT(BLUE_TXT(" option needs the video's file to be given with")) YELLOW_TXT(" \"-o\"\n"));
+        abort();
+    }
+    if (opts->dry_run && (opts->in_path || opts->watch || opts->resume)) { // the frames must all be there up-front
+        fprintf(stderr, BOLD_TXT(RED_TXT("Error:")) YELLOW_TXT(" \"-dry-run\" ")
+                        UNDERLINED_TXT(BLUE_TXT(" option cannot be combined with")) YELLOW_TXT(" \"%s\"\n"),
+                        opts->in_path ? "-in" : opts->watch ? "-watch" : "-resume");
+        abort();
+    }
+    if (opts->sync_every && !opts->del) { // the syncing is only there to hold the deletions back
+        fprintf(stderr, BOLD_TXT(RED_TXT("Error:")) YELLOW_TXT(" \"-sync\" ")
+                        UNDERLINED_TXT(BLUE_TXT(" option needs the BMPs to be deleted with")) YELLOW_TXT(" \"-d\"\n"));
+        abort();
+    }
+    if (opts->stream && opts->dedup) { // "-stream" never has a whole converted frame to reuse
+        fprintf(stderr, BOLD_TXT(RED_TXT("Error:")) YELLOW_TXT(" \"-dedup\" ")
+                        UNDERLINED_TXT(BLUE_TXT(" option cannot be combined with")) YELLOW_TXT(" \"-stream\"\n"));
+        abort();
+    }
+    if (opts->incremental && (opts->stream || opts->dedup)) { // "-dedup" would write frames that aren't the last one
+        fprintf(stderr, BOLD_TXT(RED_TXT("Error:")) YELLOW_TXT(" \"-incr\" ")
+                        UNDERLINED_TXT(BLUE_TXT(" option cannot be combined with")) YELLOW_TXT(" \"%s\"\n"),
+                        opts->stream ? "-stream" : "-dedup");
+        abort();
+    }
+    if (opts->stream && opts->vid_path && equal(opts->vid_path, "-")) { // "-stream" needs to seek within each frame
+        fprintf(stderr, BOLD_TXT(RED_TXT("Error:")) YELLOW_TXT(" \"-stream\" ")
+                        UNDERLINED_TXT(BLUE_TXT(" option cannot be combined with")) YELLOW_TXT(" \"-o -\"\n"));
+        abort();
     }
-    if (!*path_to_folder)
-        *path_to_folder = get_cur_dir();
+    if (!opts->folder_path)
+        opts->folder_path = get_cur_dir();
 }
@@ -0,0 +1,752 @@
+//
+// multithreaded read -> convert -> write frame pipeline
+//
+
+#pragma once
+
+#include "simd.h"
+#include "threads.h"
+#include "filemap.h"
+#include "bmpstream.h"
+#include "watch.h"
+#include "resume.h"
+#include "stats.h"
+#include "trace.h"
+#include "deleter.h"
+#include "progress.h"
+
+/* Frames flow through a ring of slots, frame i always using slot i % num_slots, so that at most num_slots frames are
+ * ever in memory at once (the queue depth). Readers claim frames in order and wait for their slot to be released by
+ * the writer, converters pick up whichever read frames have the lowest index, and the writer (the calling thread)
+ * writes the frames out strictly in order, releasing each slot to the frame num_slots further on. A single lock
+ * guards the state of all slots - each frame only needs it a handful of times, so it is never contended for long.
+ * When there are fewer frames than converters (e.g. a short sequence of 8K renders), each frame is further split into
+ * horizontal stripes, aligned to the rows sub-sampled together, which the converters claim & convert independently
+ * straight into the right offsets of the Y, Cb & Cr planes. When the BMPs come from a stream rather than from files,
+ * a single reader copies each one into its slot's buffer, & the number of frames is only known once the stream ends -
+ * as is the case when watching a directory for BMPs, which are then handed out one at a time to a single reader.
+ * With "-dedup", each frame's pixels are hashed as it's read in, & the last few distinct frames written are kept in a
+ * small cache: a frame with the same hash as one in the cache isn't converted at all, the cached frame being written
+ * out again in its place. A frame's buffer enters the cache by being swapped with the buffer evicted from it, so
+ * nothing is copied. If the cached frame happens to be evicted before the duplicate is written, the writer converts
+ * the duplicate itself after all - its BMP is still mapped at that point.
+ * With "-incr", each frame is compared against the frame before it in TILE_SIZE x TILE_SIZE tiles, which are aligned to
+ * the sub-sampling grid, so a tile's Y, Cb & Cr samples only ever depend on its own pixels: only the tiles that differ
+ * are converted (into the slot's buffer, laid out as in a whole frame), & the writer patches them into the last frame
+ * written, which is then written out again. The previous frame's slot is held onto until the frame after it has been
+ * written, so that its pixels are there to compare against - any frame the previous one of which isn't in a slot
+ * (the first one, or one read ahead of it by another reader) is converted whole, & replaces the last frame outright.
+ * When the video is a regular file (& neither "-dedup" nor "-incr" is used, both of which need the frames written in
+ * order), the converter that finishes a frame writes it straight to its offset in the video itself (see output.h), so
+ * frames are written in parallel & out of order, & the writer is only left to keep track of which frames have been
+ * written so far - for the checkpoints & the progress - & to release their slots in order.
+ * With "-stats", each slot also carries the time its frame took to read & convert, which the writer records (in order,
+ * so no other thread ever touches the statistics) along with the time the frame took to write - see stats.h.
+ * With "-d", the writer hands each BMP over to be deleted in the background as its slot is released - so never before
+ * its frame has been written - see deleter.h. */
+
+#define MIN_STRIPE_ROWS 16 // stripes any thinner than this aren't worth the extra locking
+#define HASH_PRIME_1 0x9e3779b97f4a7c15ull
+#define HASH_PRIME_2 0xc2b2ae3d27d4eb4full
+
+typedef enum {
+    SLOT_FREE, SLOT_READING, SLOT_READ, SLOT_CONVERTING, SLOT_CONVERTED
+} slot_state;
+
+typedef struct { // 128 bits, so that two different frames having the same hash isn't a practical concern
+    unsigned long long lo;
+    unsigned long long hi;
+} frame_hash;
+
+typedef struct {
+    frame_hash hash;
+    unsigned char *buf; // the converted frame
+    size_t last_used; // index of the last frame written from this entry, for evicting the least recently used
+    bool valid;
+} cache_entry;
+
+typedef struct {
+    file_map map; // the BMP, mapped into memory (unmapped once the frame has been written)
+    unsigned char *buf; // holds the BMP when read from a stream, kept for the slot's later frames
+    size_t buf_size;
+    const colour *input; // first pixel of the top row of the frame, rows below it following pl->stride bytes apart
+    unsigned char *final_clrs; // the converted frame
+    size_t index; // index of the frame the slot currently holds (or is waiting for)
+    slot_state state;
+    unsigned int next_stripe; // next stripe of the frame to be claimed by a converter
+    unsigned int stripes_done; // number of stripes of the frame converted so far
+    frame_hash hash; // of the frame's pixels, if deduplicating
+    bool reused; // whether the frame is a duplicate of one in the cache, & so hasn't been converted
+    unsigned char *dirty; // with "-incr": one flag per tile, set if the tile differs from the previous frame's
+    bool delta; // whether only the tiles flagged in dirty have been converted
+    unsigned long long read_ns; // with "-stats": time spent reading the frame in & converting it
+    unsigned long long convert_ns;
+    unsigned long long write_ns; // time the converter took to write the frame, when positioned
+    size_t read_bytes; // size of the BMP
+    char *path; // with "-d": a copy of the BMP's path, for deleting it once the frame has been written
+    size_t path_cap;
+} frame_slot;
+
+typedef struct {
+    const char *const *paths; // sorted BMP paths, one per frame
+    bmp_stream *in; // if not NULL, the frames are read from here instead of from paths
+    dir_watch *watch; // likewise, the frames are the BMPs found by this if not NULL
+    size_t num_frames; // SIZE_MAX for a stream or a watched directory, until its end is reached
+    unsigned int width; // dimensions of the video
+    unsigned int height;
+    unsigned int bmp_width; // dimensions all BMPs must have
+    unsigned int bmp_height;
+    size_t row_size; // size of each row of the BMPs' pixel arrays, padding included
+    ptrdiff_t stride; // offset from one row of the video to the next in the pixel arrays (BMPs are stored bottom-up)
+    size_t frame_size;
+    video_out *out;
+    bool positioned; // whether each frame is written at its offset by the converter that finishes it
+    conv_kernel kernel;
+    const char *kernel_name; // e.g. "output_420", for the trace
+    diff_kernel diff; // finds the tiles that differ between frames, with "-incr"
+    unsigned int h_sub; // number of luma samples per chroma sample horizontally & vertically
+    unsigned int v_sub;
+    unsigned int num_stripes; // number of stripes each frame is converted in (0 -> decided automatically)
+    unsigned int stripe_rows; // rows per stripe (a multiple of v_sub), except for the last stripe of each frame
+    bool del; // whether to delete each BMP once its frame has been written (see deleter.h)
+    unsigned int sync_every; // frames between syncs of the video, which the BMPs are only deleted after (0 -> none)
+    bool prog; // whether to report the progress (see progress.h)
+    unsigned int prog_rate; // max. number of times a second the progress is refreshed on a terminal
+    FILE *msgs; // where the progress is printed
+    run_stats *stats; // per-stage timings, if wanted (NULL otherwise)
+    checkpoint *ckpt; // checkpoints of the video written so far (ckpt->path is NULL if they're not wanted)
+    unsigned int cache_size; // number of distinct converted frames kept for reuse (0 -> no deduplication)
+    cache_entry *cache;
+    size_t num_reused; // number of frames written from the cache rather than converted
+    bool incremental; // whether only the tiles that differ from the previous frame are converted
+    unsigned int tiles_x; // number of tiles across & down each frame
+    unsigned int tiles_y;
+    unsigned char *base; // with "-incr": the last frame written, which the tiles of the next one are patched into
+    size_t num_tiles; // number of tiles converted so far
+    unsigned int num_readers;
+    unsigned int num_converters;
+    unsigned int num_slots;
+    frame_slot *slots;
+    size_t next_read; // next frame to be claimed by a reader
+    size_t next_convert; // number of frames claimed by converters so far
+    mutex_t lock;
+    cond_t slot_freed;
+    cond_t frame_read;
+    cond_t frame_converted;
+} pipeline;
+
+static inline unsigned long long rotl64(unsigned long long val, int bits) {
+    return (val << bits) | (val >> (64 - bits));
+}
+
+// hashes the pixels of the frame the video is made from (i.e. not the padding, nor any trimmed row or column)
+void hash_frame(const pipeline *pl, frame_slot *slot) {
+    unsigned long long lo[2] = {HASH_PRIME_1, HASH_PRIME_2}; // alternate words go to alternate pairs of lanes, each
+    unsigned long long hi[2] = {HASH_PRIME_2, HASH_PRIME_1}; // word going into two of them, to keep all 128 bits
+    unsigned long long word;
+    size_t row_bytes = ((size_t) pl->width)*sizeof(colour);
+    const unsigned char *row = (const unsigned char *) slot->input;
+    for (unsigned int y = 0; y < pl->height; ++y, row += pl->stride) {
+        size_t x = 0;
+        for (; x + 16 <= row_bytes; x += 16) { // four independent lanes, to hide the latency of the multiplications
+            for (int i = 0; i < 2; ++i) {
+                word = load_u64(row + x + 8*i);
+                lo[i] = rotl64(lo[i] ^ word, 29)*HASH_PRIME_1;
+                hi[i] = rotl64(hi[i] + word, 31)*HASH_PRIME_2;
+            }
+        }
+        for (word = 0; x < row_bytes; ++x)
+            word = (word << 8) | *(row + x);
+        lo[0] = rotl64(lo[0] ^ word, 29)*HASH_PRIME_1;
+        hi[0] = rotl64(hi[0] + word, 31)*HASH_PRIME_2;
+    }
+    lo[0] ^= rotl64(lo[1], 17)*HASH_PRIME_2;
+    hi[0] ^= rotl64(hi[1], 23)*HASH_PRIME_1;
+    slot->hash.lo = lo[0] ^ (hi[0] >> 32); // final mixing, so every bit of the input affects both halves
+    slot->hash.hi = hi[0] ^ (lo[0] >> 29);
+}
+
+static cache_entry *find_cached(const pipeline *pl, const frame_hash *hash) { // NULL if the frame isn't cached
+    for (cache_entry *entry = pl->cache; entry < pl->cache + pl->cache_size; ++entry)
+        if (entry->valid && entry->hash.lo == hash->lo && entry->hash.hi == hash->hi)
+            return entry;
+    return NULL;
+}
+
+// puts the frame just written from slot in the cache, in place of the least recently used frame (lock must be held)
+static void cache_frame(pipeline *pl, frame_slot *slot) {
+    cache_entry *victim = pl->cache;
+    for (cache_entry *entry = pl->cache; entry < pl->cache + pl->cache_size; ++entry) {
+        if (!entry->valid) {
+            victim = entry;
+            break;
+        }
+        if (entry->last_used < victim->last_used)
+            victim = entry;
+    }
+    unsigned char *buf = victim->buf; // the evicted frame's buffer is the slot's to convert into from now on
+    victim->buf = slot->final_clrs;
+    slot->final_clrs = buf;
+    victim->hash = slot->hash;
+    victim->last_used = slot->index;
+    victim->valid = true;
+}
+
+static void keep_path(frame_slot *slot, const char *path) {
+    size_t size = strlen_c(path) + 1;
+    if (size > slot->path_cap) {
+        free(slot->path);
+        slot->path = malloc(size);
+        if (!slot->path) {
+            fprintf(stderr, "Memory allocation error when reading \"%s\".\n", path);
+            abort();
+        }
+        slot->path_cap = size;
+    }
+    strcpy_c(slot->path, path);
+}
+
+void read_frame(const pipeline *pl, const char *path, frame_slot *slot) { // maps the BMP - its pixels aren't copied
+    slot->read_bytes = 0;
+    unsigned long long beg_ns = trace_begin();
+    if (!map_file(&slot->map, path)) {
+        fprintf(stderr, "File \"%s\" could not be opened.\n", path);
+        abort();
+    }
+    trace_end("open", slot->index, beg_ns);
+    beg_ns = trace_begin();
+    const unsigned char *px_arr = slot->map.data + check_bmp(slot->map.data, slot->map.size, path, pl->bmp_width,
+                                                             pl->bmp_height, pl->row_size);
+    trace_end("check_bmp", slot->index, beg_ns);
+    slot->input = (const colour *) (px_arr + (pl->height - 1)*pl->row_size); // y4m videos are inverted compared to BMPs
+    slot->read_bytes = slot->map.size;
+    if (pl->del) // the path may not outlive the read (when watching), & the BMP is only deleted once written
+        keep_path(slot, path);
+}
+
+bool read_stream_frame(const pipeline *pl, frame_slot *slot) { // returns false once the stream has ended
+    unsigned long long beg_ns = trace_begin();
+    size_t size = read_stream_bmp(pl->in, &slot->buf, &slot->buf_size);
+    if (!size)
+        return false;
+    trace_end("read", slot->index, beg_ns);
+    beg_ns = trace_begin();
+    const unsigned char *px_arr = slot->buf + check_bmp(slot->buf, size, pl->in->name, pl->bmp_width, pl->bmp_height,
+                                                        pl->row_size);
+    trace_end("check_bmp", slot->index, beg_ns);
+    slot->input = (const colour *) (px_arr + (pl->height - 1)*pl->row_size);
+    slot->read_bytes = size;
+    return true;
+}
+
+void reader_thread(void *arg) {
+    pipeline *pl = arg;
+    frame_slot *slot;
+    size_t index;
+    const char *path;
+    bool more;
+    unsigned long long beg_ns;
+    trace_thread_name("reader");
+    if (pl->in) // the only thread SIGINT can interrupt, so that it stops waiting for the stream (see run_pipeline())
+        block_sigint(false);
+    mutex_lock(&pl->lock);
+    while (pl->next_read < pl->num_frames) {
+        index = pl->next_read++;
+        slot = pl->slots + index % pl->num_slots;
+        while ((slot->index != index || slot->state != SLOT_FREE) && index < pl->num_frames)
+            cond_wait(&pl->slot_freed, &pl->lock);
+        if (index >= pl->num_frames) // stopped early (see run_pipeline())
+            break;
+        slot->state = SLOT_READING;
+        mutex_unlock(&pl->lock);
+        more = true;
+        beg_ns = 0;
+        if (pl->in) { // the wait for the stream's next BMP counts towards the read, as it's time spent reading it in
+            beg_ns = pl->stats ? get_time_ns() : 0;
+            more = read_stream_frame(pl, slot);
+        }
+        else {
+            path = pl->watch ? next_watched_bmp(pl->watch) : *(pl->paths + index); // the wait for a BMP doesn't
+            beg_ns = pl->stats ? get_time_ns() : 0;
+            if (path)
+                read_frame(pl, path, slot);
+            else
+                more = false;
+        }
+        slot->read_ns = pl->stats ? get_time_ns() - beg_ns : 0;
+        if (more && pl->cache_size) {
+            beg_ns = trace_begin();
+            hash_frame(pl, slot);
+            trace_end("hash_frame", index, beg_ns);
+        }
+        mutex_lock(&pl->lock);
+        if (!more) {
+            slot->state = SLOT_FREE;
+            if (index < pl->num_frames) // there's only ever one reader in this case, so this is the last frame claimed
+                pl->num_frames = index;
+            cond_broadcast(&pl->frame_read); // so the converters & writer can see that there is no more to do
+            cond_broadcast(&pl->frame_converted);
+            break;
+        }
+        slot->state = SLOT_READ;
+        cond_broadcast(&pl->frame_read);
+    }
+    mutex_unlock(&pl->lock);
+}
+
+void convert_stripe(const pipeline *pl, frame_slot *slot, unsigned int stripe) {
+    size_t width = pl->width;
+    size_t chroma_width = width/pl->h_sub;
+    size_t luma_size = width*pl->height;
+    size_t chroma_size = chroma_width*(pl->height/pl->v_sub);
+    unsigned int row = stripe*pl->stripe_rows;
+    unsigned int rows = pl->height - row < pl->stripe_rows ? pl->height - row : pl->stripe_rows;
+    size_t chroma_offset = chroma_width*(row/pl->v_sub);
+    pl->kernel(next_row(slot->input, pl->stride*(ptrdiff_t) row), pl->stride, slot->final_clrs + width*row,
+               slot->final_clrs + luma_size + chroma_offset, slot->final_clrs + luma_size + chroma_size + chroma_offset,
+               pl->width, rows);
+}
+
+// flags the tiles of a band of rows (at most TILE_SIZE of them) where the rows of cur & prev differ
+static void find_dirty_tiles(const pipeline *pl, const colour *cur, const colour *prev, unsigned int rows,
+                             unsigned char *dirty) {
+    for (unsigned int i = 0; i < pl->tiles_x; ++i)
+        *(dirty + i) = 0;
+    for (unsigned int y = 0; y < rows; ++y, cur = next_row(cur, pl->stride), prev = next_row(prev, pl->stride))
+        pl->diff((const unsigned char *) cur, (const unsigned char *) prev, ((size_t) pl->width)*sizeof(colour),
+                 dirty);
+}
+
+// finds the next run of dirty tiles in a row of them, from *tile on - returns false if there are none left
+static inline bool next_dirty_run(const pipeline *pl, const unsigned char *dirty, unsigned int *tile,
+                                  unsigned int *end) {
+    for (; *tile < pl->tiles_x && !*(dirty + *tile); ++*tile);
+    for (*end = *tile; *end < pl->tiles_x && *(dirty + *end); ++*end);
+    return *tile < pl->tiles_x;
+}
+
+/* copies columns [x, x + w) of rows [row, row + rows) (in luma samples) of all 3 planes from src to the frame at dst,
+ * src being either a whole frame too, or just those samples, each plane packed after the other (if packed) */
+static void copy_region(const pipeline *pl, unsigned char *dst, const unsigned char *src, bool packed, unsigned int x,
+                        unsigned int w, unsigned int row, unsigned int rows) {
+    size_t width = pl->width;
+    size_t chroma_width = width/pl->h_sub;
+    size_t luma_size = width*pl->height;
+    size_t chroma_size = chroma_width*(pl->height/pl->v_sub);
+    size_t chroma_w = w/pl->h_sub;
+    unsigned int chroma_rows = rows/pl->v_sub;
+    size_t offsets[3] = {width*row + x, luma_size + chroma_width*(row/pl->v_sub) + x/pl->h_sub,
+                         luma_size + chroma_size + chroma_width*(row/pl->v_sub) + x/pl->h_sub};
+    size_t packed_offsets[3] = {0, w*rows, w*rows + chroma_w*chroma_rows};
+    for (int plane = 0; plane < 3; ++plane) {
+        size_t pitch = plane ? chroma_width : width;
+        size_t bytes = plane ? chroma_w : w;
+        unsigned char *to = dst + *(offsets + plane);
+        const unsigned char *from = src + *((packed ? packed_offsets : offsets) + plane);
+        for (unsigned int y = 0; y < (plane ? chroma_rows : rows); ++y, to += pitch, from += packed ? bytes : pitch)
+            for (size_t i = 0; i < bytes; ++i)
+                *(to + i) = *(from + i);
+    }
+}
+
+/* converts only the tiles of a stripe that differ from those of the previous frame, which the slot before holds, into
+ * the slot's buffer - scratch holds a band of converted rows before they're copied into place */
+void convert_stripe_delta(const pipeline *pl, frame_slot *slot, unsigned int stripe, unsigned char *scratch) {
+    const frame_slot *prev = pl->slots + (slot->index - 1) % pl->num_slots;
+    unsigned int row = stripe*pl->stripe_rows;
+    unsigned int end = pl->height - row < pl->stripe_rows ? pl->height : row + pl->stripe_rows;
+    unsigned int rows;
+    unsigned int tile;
+    unsigned int run_end;
+    for (; row < end; row += rows) {
+        rows = end - row < TILE_SIZE ? end - row : TILE_SIZE; // a multiple of v_sub either way
+        unsigned char *dirty = slot->dirty + (row/TILE_SIZE)*pl->tiles_x;
+        const colour *input = next_row(slot->input, pl->stride*(ptrdiff_t) row);
+        find_dirty_tiles(pl, input, next_row(prev->input, pl->stride*(ptrdiff_t) row), rows, dirty);
+        for (tile = 0; next_dirty_run(pl, dirty, &tile, &run_end); tile = run_end) {
+            unsigned int x = tile*TILE_SIZE;
+            unsigned int w = (run_end*TILE_SIZE < pl->width ? run_end*TILE_SIZE : pl->width) - x;
+            size_t luma = ((size_t) w)*rows;
+            size_t chroma = (w/pl->h_sub)*(rows/pl->v_sub);
+            pl->kernel(input + x, pl->stride, scratch, scratch + luma, scratch + luma + chroma, w, rows);
+            copy_region(pl, slot->final_clrs, scratch, true, x, w, row, rows);
+        }
+    }
+}
+
+// patches the tiles converted for a frame into the last frame written, returning how many there were
+static size_t patch_frame(const pipeline *pl, const frame_slot *slot) {
+    size_t count = 0;
+    unsigned int tile;
+    unsigned int run_end;
+    for (unsigned int ty = 0; ty < pl->tiles_y; ++ty) {
+        unsigned int row = ty*TILE_SIZE;
+        unsigned int rows = pl->height - row < TILE_SIZE ? pl->height - row : TILE_SIZE;
+        const unsigned char *dirty = slot->dirty + ty*pl->tiles_x;
+        for (tile = 0; next_dirty_run(pl, dirty, &tile, &run_end); tile = run_end) {
+            unsigned int x = tile*TILE_SIZE;
+            unsigned int w = (run_end*TILE_SIZE < pl->width ? run_end*TILE_SIZE : pl->width) - x;
+            copy_region(pl, pl->base, slot->final_clrs, false, x, w, row, rows);
+            count += run_end - tile;
+        }
+    }
+    return count;
+}
+
+void converter_thread(void *arg) {
+    pipeline *pl = arg;
+    frame_slot *slot;
+    frame_slot *end = pl->slots + pl->num_slots;
+    frame_slot *next;
+    frame_slot *prev;
+    unsigned int stripe;
+    unsigned long long beg_ns = 0;
+    unsigned long long trace_ns;
+    unsigned char *scratch = NULL; // a band of the tiles converted with "-incr", as wide as the whole frame at most
+    if (pl->incremental && !(scratch = malloc(((size_t) pl->width)*TILE_SIZE*sizeof(colour)))) {
+        fprintf(stderr, "Memory allocation error when setting up a converter.\n");
+        abort();
+    }
+    trace_thread_name("converter");
+    mutex_lock(&pl->lock);
+    for (;;) {
+        next = NULL; // a frame already being converted takes priority, so the writer gets it as soon as possible
+        for (slot = pl->slots; slot < end; ++slot)
+            if (slot->state == SLOT_CONVERTING && slot->next_stripe < pl->num_stripes &&
+                (!next || slot->index < next->index))
+                next = slot;
+        if (!next) {
+            for (slot = pl->slots; slot < end; ++slot)
+                if (slot->state == SLOT_READ && (!next || slot->index < next->index))
+                    next = slot;
+            if (!next) {
+                if (pl->next_convert >= pl->num_frames)
+                    break;
+                cond_wait(&pl->frame_read, &pl->lock);
+                continue;
+            }
+            ++pl->next_convert;
+            cache_entry *cached = pl->cache_size ? find_cached(pl, &next->hash) : NULL;
+            next->reused = cached != NULL;
+            next->convert_ns = 0;
+            if (pl->cache_size && !cached) // an earlier frame still in the queue is as good, being cached once written
+                for (slot = pl->slots; slot < end && !next->reused; ++slot)
+                    next->reused = slot->index < next->index && slot->state >= SLOT_READ &&
+                                   slot->hash.lo == next->hash.lo && slot->hash.hi == next->hash.hi;
+            if (next->reused) { // a duplicate of a frame already written (or to be) - see run_pipeline()
+                if (cached)
+                    cached->last_used = next->index; // keeps it from being evicted before the duplicate is written
+                next->state = SLOT_CONVERTED;
+                cond_broadcast(&pl->frame_converted);
+                if (pl->next_convert == pl->num_frames)
+                    cond_broadcast(&pl->frame_read); // wake up any other converters so they can exit
+                continue;
+            }
+            prev = pl->slots + (next->index - 1) % pl->num_slots; // held onto until next is written (if in use)
+            next->delta = pl->incremental && next->index && prev->index == next->index - 1 &&
+                          prev->state >= SLOT_READ;
+            next->state = SLOT_CONVERTING;
+            next->next_stripe = 0;
+            next->stripes_done = 0;
+            if (pl->num_stripes > 1)
+                cond_broadcast(&pl->frame_read); // the rest of the frame's stripes are up for grabs
+        }
+        stripe = next->next_stripe++;
+        if (pl->next_convert == pl->num_frames && next->next_stripe == pl->num_stripes)
+            cond_broadcast(&pl->frame_read); // wake up any other converters so they can exit
+        mutex_unlock(&pl->lock);
+        if (pl->stats)
+            beg_ns = get_time_ns();
+        trace_ns = trace_begin();
+        if (next->delta)
+            convert_stripe_delta(pl, next, stripe, scratch);
+        else
+            convert_stripe(pl, next, stripe);
+        trace_end(pl->kernel_name, next->index, trace_ns);
+        mutex_lock(&pl->lock);
+        if (pl->stats) // the stripes' times are added up (see stats.h)
+            next->convert_ns += get_time_ns() - beg_ns;
+        if (++next->stripes_done == pl->num_stripes) {
+            if (pl->positioned) { // no other thread touches the slot until it's marked as converted
+                mutex_unlock(&pl->lock);
+                if (pl->stats)
+                    beg_ns = get_time_ns();
+                trace_ns = trace_begin();
+                write_frame_at(pl->out, next->final_clrs, pl->frame_size, next->index);
+                trace_end("write_frame", next->index, trace_ns);
+                next->write_ns = pl->stats ? get_time_ns() - beg_ns : 0;
+                mutex_lock(&pl->lock);
+            }
+            next->state = SLOT_CONVERTED;
+            cond_broadcast(&pl->frame_converted);
+        }
+    }
+    mutex_unlock(&pl->lock);
+    free(scratch);
+}
+// sets up the slots & threads, then writes each frame to vid in order as it becomes available
+void run_pipeline(pipeline *pl, video_out *out) {
+    if (pl->in || pl->watch)
+        pl->num_readers = 1; // the stream has to be read in order, as do the BMPs found while watching
+    if (pl->num_readers > pl->num_frames)
+        pl->num_readers = pl->num_frames;
+    if (pl->num_converters > pl->num_frames)
+        pl->num_converters = pl->num_frames;
+    if (pl->num_slots > pl->num_frames)
+        pl->num_slots = pl->num_frames;
+    if (pl->incremental)
+        out->spliced = false; // the frame written is patched in place for the next one, so it has to be copied
+    pl->out = out;
+    pl->positioned = !pl->incremental && !pl->cache_size && start_positioned(out);
+    if ((out->spliced || pl->incremental) && pl->num_slots < 2 && pl->num_frames > 1)
+        pl->num_slots = 2; // each frame's slot is held until the next frame is written (see write_frame() & above)
+    unsigned int unit = pl->incremental ? TILE_SIZE : pl->v_sub; // with "-incr", stripes must be made of whole tiles
+    unsigned int row_groups = (pl->height + unit - 1)/unit; // stripes can only be split between these
+    if (!pl->num_stripes) { // only split frames up when there are too few of them to keep all the converters busy
+        pl->num_stripes = pl->num_frames >= pl->num_converters ? 1 :
+                          (pl->num_converters + pl->num_frames - 1)/pl->num_frames;
+        unsigned int max_stripes = pl->height/MIN_STRIPE_ROWS;
+        if (pl->num_stripes > max_stripes)
+            pl->num_stripes = max_stripes ? max_stripes : 1;
+    }
+    if (pl->num_stripes > row_groups)
+        pl->num_stripes = row_groups;
+    pl->stripe_rows = ((row_groups + pl->num_stripes - 1)/pl->num_stripes)*unit;
+    pl->num_stripes = (pl->height + pl->stripe_rows - 1)/pl->stripe_rows; // rounding up can leave fewer stripes
+    pl->slots = malloc(pl->num_slots*sizeof(frame_slot));
+    if (!pl->slots) {
+        fprintf(stderr, "Memory allocation error when setting up the frame queue.\n");
+        abort();
+    }
+    for (unsigned int i = 0; i < pl->num_slots; ++i) {
+        (pl->slots + i)->map.data = NULL;
+        (pl->slots + i)->map.size = 0;
+        (pl->slots + i)->buf = NULL;
+        (pl->slots + i)->buf_size = 0;
+        (pl->slots + i)->final_clrs = malloc(pl->frame_size);
+        if (!(pl->slots + i)->final_clrs) {
+            fprintf(stderr, "Memory allocation error, likely due to overly large BMP file size or queue depth.\n");
+            abort();
+        }
+        (pl->slots + i)->index = i;
+        (pl->slots + i)->state = SLOT_FREE;
+        (pl->slots + i)->next_stripe = 0;
+        (pl->slots + i)->stripes_done = 0;
+        (pl->slots + i)->reused = false;
+        (pl->slots + i)->dirty = NULL;
+        (pl->slots + i)->delta = false;
+        (pl->slots + i)->path = NULL;
+        (pl->slots + i)->path_cap = 0;
+    }
+    pl->tiles_x = (pl->width + TILE_SIZE - 1)/TILE_SIZE;
+    pl->tiles_y = (pl->height + TILE_SIZE - 1)/TILE_SIZE;
+    pl->base = NULL;
+    if (pl->incremental) {
+        pl->base = malloc(pl->frame_size);
+        if (!pl->base) {
+            fprintf(stderr, "Memory allocation error, likely due to overly large BMP file size.\n");
+            abort();
+        }
+        for (unsigned int i = 0; i < pl->num_slots; ++i) {
+            (pl->slots + i)->dirty = malloc(((size_t) pl->tiles_x)*pl->tiles_y);
+            if (!(pl->slots + i)->dirty) {
+                fprintf(stderr, "Memory allocation error when setting up the frame queue.\n");
+                abort();
+            }
+        }
+    }
+    pl->num_tiles = 0;
+    if (out->spliced && pl->cache_size == 1)
+        pl->cache_size = 2; // a frame spliced from the cache mustn't be evicted as soon as the next one is written
+    pl->cache = NULL;
+    if (pl->cache_size) {
+        pl->cache = malloc(pl->cache_size*sizeof(cache_entry));
+        if (!pl->cache) {
+            fprintf(stderr, "Memory allocation error when setting up the frame cache.\n");
+            abort();
+        }
+        for (unsigned int i = 0; i < pl->cache_size; ++i) {
+            (pl->cache + i)->buf = malloc(pl->frame_size);
+            (pl->cache + i)->valid = false;
+            if (!(pl->cache + i)->buf) {
+                fprintf(stderr, "Memory allocation error, likely due to overly large BMP file size or cache size.\n");
+                abort();
+            }
+        }
+    }
+    pl->num_reused = 0;
+    pl->next_read = 0;
+    pl->next_convert = 0;
+    mutex_init(&pl->lock);
+    cond_init(&pl->slot_freed);
+    cond_init(&pl->frame_read);
+    cond_init(&pl->frame_converted);
+    thread_t *threads = malloc((pl->num_readers + pl->num_converters)*sizeof(thread_t));
+    if (!threads) {
+        fprintf(stderr, "Memory allocation error when creating threads.\n");
+        abort();
+    }
+    unsigned int t = 0;
+    if (pl->in) // SIGINT is left to the reader, which may be waiting for the stream's next BMP for good
+        block_sigint(true);
+    for (; t < pl->num_readers; ++t)
+        thread_create(threads + t, reader_thread, pl);
+    for (; t < pl->num_readers + pl->num_converters; ++t)
+        thread_create(threads + t, converter_thread, pl);
+    frame_slot *slot;
+    frame_slot *done;
+    cache_entry *cached;
+    const unsigned char *frame;
+    frame_slot *held = NULL; // slot of the last frame spliced into the output, which the pipe may still be reading
+    deleter dl;
+    if (pl->del)
+        start_deleter(&dl, out->fp, out->fd, pl->sync_every, pl->ckpt);
+    progress pr;
+    size_t start_size = out->size;
+    if (pl->prog)
+        start_progress(&pr, pl->msgs, pl->prog_rate, pl->num_frames);
+    size_t num_frames;
+    unsigned long long beg_ns = 0;
+    unsigned long long trace_ns;
+    unsigned long long stage_ns[NUM_STAGES];
+    size_t stage_bytes[NUM_STAGES];
+    trace_thread_name("writer");
+    for (size_t i = 0;; ++i) {
+        slot = pl->slots + i % pl->num_slots;
+        mutex_lock(&pl->lock);
+        while ((slot->index != i || slot->state != SLOT_CONVERTED) && i < pl->num_frames)
+            cond_wait(&pl->frame_converted, &pl->lock);
+        num_frames = pl->num_frames;
+        mutex_unlock(&pl->lock);
+        if (i >= num_frames)
+            break;
+        frame = slot->final_clrs;
+        if (slot->reused) {
+            mutex_lock(&pl->lock);
+            if ((cached = find_cached(pl, &slot->hash)))
+                cached->last_used = i;
+            mutex_unlock(&pl->lock);
+            if (cached) { // only this thread ever changes the cached frames themselves
+                frame = cached->buf;
+                ++pl->num_reused;
+            }
+            else { // evicted since the converter found it - so convert the frame after all
+                if (pl->stats)
+                    beg_ns = get_time_ns();
+                trace_ns = trace_begin();
+                for (unsigned int stripe = 0; stripe < pl->num_stripes; ++stripe)
+                    convert_stripe(pl, slot, stripe);
+                trace_end(pl->kernel_name, i, trace_ns);
+                slot->reused = false;
+                if (pl->stats)
+                    slot->convert_ns = get_time_ns() - beg_ns;
+            }
+        }
+        if (pl->incremental) {
+            unsigned char *frame_buf = slot->final_clrs;
+            if (pl->stats)
+                beg_ns = get_time_ns();
+            if (slot->delta) { // patching the tiles in is the last part of converting the frame
+                trace_ns = trace_begin();
+                pl->num_tiles += patch_frame(pl, slot);
+                trace_end("patch_frame", i, trace_ns);
+                if (pl->stats)
+                    slot->convert_ns += get_time_ns() - beg_ns;
+            }
+            else { // converted whole, so it takes over from the last frame written (only this thread uses base)
+                pl->num_tiles += ((size_t) pl->tiles_x)*pl->tiles_y;
+                slot->final_clrs = pl->base;
+                pl->base = frame_buf;
+            }
+            frame = pl->base;
+        }
+        if (pl->stats) {
+            beg_ns = get_time_ns();
+            *(stage_bytes + STAGE_WRITE) = out->size;
+        }
+        if (pl->positioned) // already written by the converter
+            out->size += sizeof(frame_line) - 1 + pl->frame_size;
+        else {
+            trace_ns = trace_begin();
+            write_frame(out, frame, pl->frame_size); // each frame starts with "FRAME\n"
+            trace_end("write_frame", i, trace_ns);
+            slot->write_ns = pl->stats ? get_time_ns() - beg_ns : 0;
+        }
+        if (pl->stats) {
+            *(stage_ns + STAGE_READ) = slot->read_ns;
+            *(stage_ns + STAGE_CONVERT) = slot->convert_ns;
+            *(stage_ns + STAGE_WRITE) = slot->write_ns;
+            *(stage_bytes + STAGE_READ) = slot->read_bytes;
+            *(stage_bytes + STAGE_CONVERT) = slot->reused ? 0 : ((size_t) pl->width)*pl->height*sizeof(colour);
+            *(stage_bytes + STAGE_WRITE) = out->size - *(stage_bytes + STAGE_WRITE); // the "FRAME" line included
+            add_frame_stats(pl->stats, stage_ns, stage_bytes);
+        }
+        if (pl->cache_size && !slot->reused) {
+            mutex_lock(&pl->lock);
+            if ((cached = find_cached(pl, &slot->hash))) // converted by two converters at once
+                cached->last_used = i;
+            else
+                cache_frame(pl, slot);
+            mutex_unlock(&pl->lock);
+        }
+        done = slot;
+        if (out->spliced || pl->incremental) {
+            done = held;
+            held = slot;
+        }
+        if (done) {
+            unmap_file(&done->map); // nothing else can be using the slot until it's freed below
+            if (pl->del) // only once unmapped, as a mapped file can't be deleted on Windows
+                delete_when_written(&dl, done->path);
+            mutex_lock(&pl->lock);
+            done->index += pl->num_slots;
+            done->state = SLOT_FREE;
+            cond_broadcast(&pl->slot_freed);
+            mutex_unlock(&pl->lock);
+        }
+        update_checkpoint(pl->ckpt, out->fp, pl->ckpt->base + i + 1, out->size, stop_requested);
+        if (stop_requested && i + 1 < num_frames) { // SIGINT - the frames after this one are left to be resumed
+            mutex_lock(&pl->lock);
+            pl->num_frames = num_frames = i + 1;
+            cond_broadcast(&pl->slot_freed); // the readers & converters then stop as if these were all the frames
+            cond_broadcast(&pl->frame_read);
+            mutex_unlock(&pl->lock);
+        }
+        if (pl->prog)
+            update_progress(&pr, i + 1, num_frames, out->size - start_size);
+    }
+    if (pl->prog)
+        update_progress(&pr, num_frames, num_frames, out->size - start_size); // in case the stream ended
+    if (held) {
+        unmap_file(&held->map);
+        if (pl->del)
+            delete_when_written(&dl, held->path);
+    }
+    drain_video(out);
+    for (t = 0; t < pl->num_readers + pl->num_converters; ++t)
+        thread_join(*(threads + t));
+    free(threads);
+    if (pl->in)
+        block_sigint(false);
+    end_positioned(out, pl->num_frames, pl->frame_size); // drops any frames converted past a SIGINT
+    if (pl->del)
+        stop_deleter(&dl); // deletes the BMPs of the frames written since the last sync
+    if (pl->prog)
+        stop_progress(&pr);
+    cond_destroy(&pl->frame_converted);
+    cond_destroy(&pl->frame_read);
+    cond_destroy(&pl->slot_freed);
+    mutex_destroy(&pl->lock);
+    for (unsigned int i = 0; i < pl->num_slots; ++i) { // frames read past a SIGINT are still mapped
+        unmap_file(&(pl->slots + i)->map);
+        free_ptrs(4, (pl->slots + i)->final_clrs, (pl->slots + i)->buf, (pl->slots + i)->dirty, (pl->slots + i)->path);
+    }
+    free(pl->base);
+    pl->base = NULL;
+    free(pl->slots);
+    pl->slots = NULL;
+    for (unsigned int i = 0; i < pl->cache_size; ++i)
+        free((pl->cache + i)->buf);
+    free(pl->cache);
+    pl->cache = NULL;
+}
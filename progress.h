@@ -0,0 +1,126 @@
+//
+// progress of a conversion, with its frame rate, throughput & ETA, reported by a thread of its own ("-p")
+//
+
+#pragma once
+
+#include "threads.h"
+
+#ifdef _WIN32
+#include <io.h> // _isatty()
+#endif
+
+/* The writer only ever stores the number of frames written (& bytes, & the total once known) into atomic counters, so
+ * reporting the progress costs it nothing per frame - no formatting & no syscalls. A reporter thread reads them at most
+ * prog_rate times a second, & rewrites a single coloured line in place when the progress goes to a terminal. Otherwise
+ * (e.g. into a job's log) it appends a plain line every PROG_LOG_SECS seconds instead. The rates are averages over the
+ * whole run so far, & the ETA assumes that the frames still to be written go at the same rate. */
+
+#define PROG_LOG_SECS 10 // seconds between the lines logged when the progress isn't going to a terminal
+
+typedef struct {
+    FILE *fp; // stdout, unless that's where the video is going
+    bool tty; // whether fp is a terminal
+    unsigned long long interval_ns; // time between reports
+    unsigned long long start_ns;
+    atomic_count done; // number of frames written so far
+    atomic_count total; // SIZE_MAX while not known yet
+    atomic_count bytes; // number of bytes written so far
+    bool finished; // whether the writer is done
+    mutex_t lock;
+    cond_t wake;
+    thread_t thread;
+} progress;
+
+static void format_duration(char *buf, size_t size, double secs) { // as h:mm:ss
+    unsigned long long s = secs > 0 ? (unsigned long long) secs : 0;
+    snprintf(buf, size, "%llu:%02llu:%02llu", s/3600, s/60 % 60, s % 60);
+}
+
+static void print_progress(progress *pr) {
+    size_t done = load_count(&pr->done);
+    size_t total = load_count(&pr->total);
+    size_t bytes = load_count(&pr->bytes);
+    double secs = (get_time_ns() - pr->start_ns)/1e9;
+    double fps = secs > 0 ? done/secs : 0;
+    double mb_per_s = secs > 0 ? bytes/secs/1e6 : 0;
+    char elapsed[32];
+    char eta[32] = "?";
+    format_duration(elapsed, sizeof(elapsed), secs);
+    if (total != SIZE_MAX && fps > 0)
+        format_duration(eta, sizeof(eta), (total - done)/fps);
+    if (!pr->tty) {
+        if (total == SIZE_MAX)
+            fprintf(pr->fp, "Progress: %zu frames", done);
+        else
+            fprintf(pr->fp, "Progress: %zu / %zu frames (%.1f%%)", done, total, total ? 100.0*done/total : 100.0);
+        fprintf(pr->fp, ", %.1f fps, %.1f MB/s, elapsed %s, ETA %s\n", fps, mb_per_s, elapsed, eta);
+    }
+    else if (total == SIZE_MAX)
+        fprintf(pr->fp, GREEN_TXT(UNDERLINED_TXT("Frames completed:")) MAGENTA_TXT(BOLD_TXT(" %zu"))
+                CYAN_TXT("  %9.1f fps  %9.1f MB/s") YELLOW_TXT("  elapsed %s ") "\r", done, fps, mb_per_s, elapsed);
+    else
+        fprintf(pr->fp, GREEN_TXT(UNDERLINED_TXT("Frames completed:")) MAGENTA_TXT(BOLD_TXT(" %zu"))
+                YELLOW_TXT(" / ") BLUE_TXT(BOLD_TXT("%zu")) CYAN_TXT("  %9.1f fps  %9.1f MB/s")
+                YELLOW_TXT("  elapsed %s  ETA %s ") "\r", done, total, fps, mb_per_s, elapsed, eta);
+    fflush(pr->fp);
+}
+
+static void progress_thread(void *arg) {
+    progress *pr = arg;
+    unsigned long long next_ns = pr->start_ns + pr->interval_ns;
+    unsigned long long now_ns;
+    mutex_lock(&pr->lock);
+    while (!pr->finished) {
+        now_ns = get_time_ns();
+        if (now_ns < next_ns) { // woken early (or spuriously)
+            cond_timed_wait(&pr->wake, &pr->lock, (unsigned int) ((next_ns - now_ns + 999999)/1000000));
+            continue;
+        }
+        print_progress(pr);
+        next_ns = now_ns + pr->interval_ns;
+    }
+    mutex_unlock(&pr->lock);
+}
+
+// starts reporting the progress to fp, refreshing it rate times a second on a terminal - total may be SIZE_MAX
+void start_progress(progress *pr, FILE *fp, unsigned int rate, size_t total) {
+    pr->fp = fp;
+#ifdef _WIN32
+    pr->tty = _isatty(_fileno(fp)) != 0;
+#else
+    pr->tty = isatty(fileno(fp)) != 0;
+#endif
+    pr->interval_ns = pr->tty ? 1000000000ull/rate : PROG_LOG_SECS*1000000000ull;
+    if (pr->interval_ns < 1000000)
+        pr->interval_ns = 1000000; // cond_timed_wait() only goes down to milliseconds
+    pr->start_ns = get_time_ns();
+    store_count(&pr->done, 0);
+    store_count(&pr->total, total);
+    store_count(&pr->bytes, 0);
+    pr->finished = false;
+    mutex_init(&pr->lock);
+    cond_init(&pr->wake);
+    thread_create(&pr->thread, progress_thread, pr);
+}
+
+// records the frames written so far - cheap enough to call for every frame
+static inline void update_progress(progress *pr, size_t done, size_t total, size_t bytes) {
+    store_count(&pr->done, done);
+    store_count(&pr->total, total);
+    store_count(&pr->bytes, bytes);
+}
+
+// stops the reporter, then reports the final progress
+void stop_progress(progress *pr) {
+    mutex_lock(&pr->lock);
+    pr->finished = true;
+    cond_broadcast(&pr->wake);
+    mutex_unlock(&pr->lock);
+    thread_join(pr->thread);
+    print_progress(pr);
+    if (pr->tty)
+        fputc('\n', pr->fp);
+    cond_destroy(&pr->wake);
+    mutex_destroy(&pr->lock);
+}
@@ -0,0 +1,249 @@
+//
+// resuming an interrupted conversion, & the checkpoints that let a long one be resumed cheaply
+//
+
+#pragma once
+
+#include "output.h"
+
+#ifdef _WIN32
+#include <io.h>
+#endif
+
+#define CKPT_SUFFIX ".ckpt" // checkpoints are kept next to the video, with this appended to its path
+#define CKPT_INTERVAL_NS 5000000000ull // how often checkpoints are written
+#define MAX_Y4M_HEADER 512 // longer than any header yuv_header() makes
+#define DEL_SUFFIX ".del" // with "-d", the record of the BMPs deleted is kept next to the video, with this appended
+
+/* A video being resumed must start with a header with the same parameters as the one that would be written now (its
+ * X comment aside), & is made of whole "FRAME" + planes records from there on: any partial record at its end is
+ * truncated, & conversion carries on from the input frame after the last whole one. Finding the last whole record
+ * means checking the "FRAME" marker at the start of every record - the checkpoint, written every CKPT_INTERVAL_NS
+ * after the video has been flushed to disk, records how many of them are known to be intact already, so that only the
+ * frames written since the last checkpoint have to be checked. The checkpoint is deleted once the video is complete.
+ * SIGINT (Ctrl+C) doesn't kill the process outright: the frame being written is finished, a checkpoint is written, &
+ * the video is left ready to be resumed. A second SIGINT does kill it, should the first not stop it.
+ * With "-d", the BMPs of the frames in the video may or may not have been deleted yet when the conversion stopped (see
+ * deleter.h), so the number deleted is recorded next to the video, along with the path of the last one, before each
+ * deletion: if that BMP is still there, the conversion stopped just before deleting it. The BMPs that a scan or watch
+ * of the directory still finds therefore start that many frames into the video - a list (or stream) of BMPs always
+ * starts at the first frame, whether or not its BMPs are still there. */
+
+typedef struct {
+    char *path; // NULL if checkpoints aren't being written
+    char *del_path; // the record of the BMPs deleted (see above)
+    char *del_tmp_path; // what it's written to before being renamed over it
+    size_t base; // number of frames already in the video when it was resumed
+    size_t deleted; // number of BMPs deleted so far, over all the runs - only the deleter touches it while running
+    unsigned long long last_ns; // time the last checkpoint was written at
+} checkpoint;
+
+bool init_checkpoint(checkpoint *ck, const char *vid_path) {
+    size_t len = strlen_c(vid_path);
+    ck->path = malloc(len + sizeof(CKPT_SUFFIX) + 4); // + 4 for the ".tmp" of the temporary file
+    ck->del_path = malloc(len + sizeof(DEL_SUFFIX));
+    ck->del_tmp_path = malloc(len + sizeof(DEL_SUFFIX) + 4);
+    if (!ck->path || !ck->del_path || !ck->del_tmp_path) {
+        free_ptrs(3, ck->path, ck->del_path, ck->del_tmp_path);
+        ck->path = ck->del_path = ck->del_tmp_path = NULL;
+        return false;
+    }
+    strcpy_c(ck->path, vid_path);
+    strcat_c(ck->path, CKPT_SUFFIX);
+    strcpy_c(ck->del_path, vid_path);
+    strcat_c(ck->del_path, DEL_SUFFIX);
+    strcpy_c(ck->del_tmp_path, ck->del_path);
+    strcat_c(ck->del_tmp_path, ".tmp");
+    ck->base = 0;
+    ck->deleted = 0;
+    ck->last_ns = get_time_ns();
+    return true;
+}
+
+/* returns the number of BMPs deleted by the runs that wrote the video so far (see above) - 0 if none were, or if the
+ * record of them is missing or garbled */
+size_t read_deletions(checkpoint *ck) {
+    ck->deleted = 0;
+    FILE *fp = ck->del_path ? fopen(ck->del_path, "rb") : NULL;
+    if (!fp)
+        return 0;
+    unsigned long long count;
+    if (fscanf(fp, "Y4M_DELETED bmps=%llu last=", &count) == 1 && count) {
+        size_t cap = 256;
+        size_t len = 0;
+        char *last = malloc(cap);
+        int c;
+        while (last && (c = fgetc(fp)) != EOF) { // the path goes up to the newline at the very end
+            if (len + 1 == cap)
+                last = realloc(last, cap *= 2);
+            if (last)
+                *(last + len++) = (char) c;
+        }
+        if (!last) {
+            fprintf(stderr, "Memory allocation error when reading \"%s\".\n", ck->del_path);
+            abort();
+        }
+        if (len && *(last + len - 1) == '\n') {
+            *(last + --len) = 0;
+            FILE *bmp = fopen(last, "rb");
+            ck->deleted = bmp ? (size_t) count - 1 : (size_t) count; // stopped before deleting it if it's still there
+            if (bmp)
+                fclose(bmp);
+        }
+        free(last);
+    }
+    fclose(fp);
+    return ck->deleted;
+}
+
+/* records that the BMP at bmp_path is about to be deleted - returns false if the record can't be written, in which
+ * case it mustn't be. Does nothing if checkpoints aren't being written, as the video can't be resumed then anyway */
+bool record_deletion(checkpoint *ck, const char *bmp_path) {
+    if (!ck->del_path)
+        return true;
+    FILE *fp = fopen(ck->del_tmp_path, "wb");
+    if (!fp)
+        return false;
+    bool written = fprintf(fp, "Y4M_DELETED bmps=%llu last=%s\n", (unsigned long long) ck->deleted + 1, bmp_path) > 0;
+    if (fclose(fp) || !written)
+        return false;
+#ifdef _WIN32
+    if (!MoveFileExA(ck->del_tmp_path, ck->del_path, MOVEFILE_REPLACE_EXISTING))
+#else
+    if (rename(ck->del_tmp_path, ck->del_path))
+#endif
+        return false;
+    ++ck->deleted;
+    return true;
+}
+
+static bool read_checkpoint(const checkpoint *ck, size_t *frames, size_t *bytes) { // false if missing or garbled
+    FILE *fp = fopen(ck->path, "rb");
+    if (!fp)
+        return false;
+    unsigned long long num_frames;
+    unsigned long long num_bytes;
+    bool valid = fscanf(fp, "Y4M_CHECKPOINT frames=%llu bytes=%llu", &num_frames, &num_bytes) == 2;
+    fclose(fp);
+    if (valid) {
+        *frames = (size_t) num_frames;
+        *bytes = (size_t) num_bytes;
+    }
+    return valid;
+}
+
+/* records that the first frames (in total, including ck->base) of vid, bytes long, are safely on disk - unless force
+ * is false & the last checkpoint was written less than CKPT_INTERVAL_NS ago. The checkpoint is written to a temporary
+ * file that is then renamed over the last one, so there is always one complete checkpoint */
+void update_checkpoint(checkpoint *ck, FILE *vid, size_t frames, size_t bytes, bool force) {
+    if (!ck->path)
+        return;
+    unsigned long long now = get_time_ns();
+    if (!force && now - ck->last_ns < CKPT_INTERVAL_NS)
+        return;
+    ck->last_ns = now;
+    fflush(vid);
+#ifdef _WIN32
+    _commit(_fileno(vid));
+#else
+    fsync(fileno(vid)); // the frames must be on disk before the checkpoint claims they are
+#endif
+    size_t len = strlen_c(ck->path);
+    strcat_c(ck->path, ".tmp");
+    FILE *fp = fopen(ck->path, "wb");
+    if (fp) {
+        fprintf(fp, "Y4M_CHECKPOINT frames=%llu bytes=%llu\n", (unsigned long long) frames,
+                (unsigned long long) bytes);
+        fclose(fp);
+        char *tmp_path = ck->path;
+        char *final_path = malloc(len + 1); // ck->path with the ".tmp" cut off
+        for (size_t i = 0; final_path && i < len; ++i)
+            *(final_path + i) = *(tmp_path + i);
+        if (final_path) {
+            *(final_path + len) = 0;
+#ifdef _WIN32
+            MoveFileExA(tmp_path, final_path, MOVEFILE_REPLACE_EXISTING);
+#else
+            rename(tmp_path, final_path);
+#endif
+        }
+        free(final_path);
+    }
+    *(ck->path + len) = 0; // a checkpoint that can't be written isn't fatal - resuming just has more to check
+}
+
+void finish_checkpoint(checkpoint *ck, bool complete) { // deletes the checkpoint if the video is complete
+    if (!ck->path)
+        return;
+    if (complete) {
+        remove(ck->path);
+        remove(ck->del_path);
+    }
+    free_ptrs(3, ck->path, ck->del_path, ck->del_tmp_path);
+    ck->path = ck->del_path = ck->del_tmp_path = NULL;
+}
+
+static size_t header_params_len(const char *header) { // length of a y4m header up to its X comment or newline
+    const char *ptr = header;
+    for (; *ptr && *ptr != '\n' && !(*ptr == ' ' && *(ptr + 1) == 'X'); ++ptr);
+    return ptr - header;
+}
+
+/* opens the video at vid_path to carry on writing it, checking that its header matches yuv_h & dropping any partial
+ * frame at its end, & returns the number of whole frames in it (*vid is then positioned after them). If the video
+ * doesn't exist yet, it is created & has yuv_h written to it instead. Errors abort */
+size_t resume_video(video_out *vid, const char *vid_path, const char *yuv_h, size_t frame_size, const checkpoint *ck) {
+    init_video(vid, vid_path);
+    vid->fp = fopen(vid_path, "r+b");
+    if (!vid->fp) { // nothing to resume
+        if (!open_video(vid, vid_path, frame_size)) {
+            fprintf(stderr, "Error opening video output path: \"%s\"\n", vid_path);
+            perror("Error type");
+            abort();
+        }
+        write_video(vid, yuv_h, strlen_c(yuv_h));
+        return 0;
+    }
+    char header[MAX_Y4M_HEADER];
+    size_t header_len = fread(header, sizeof(char), MAX_Y4M_HEADER - 1, vid->fp);
+    *(header + header_len) = 0;
+    size_t params_len = header_params_len(yuv_h);
+    for (header_len = 0; header_len < MAX_Y4M_HEADER - 1 && *(header + header_len) != '\n'; ++header_len);
+    if (header_len == MAX_Y4M_HEADER - 1 || header_params_len(header) != params_len ||
+        !equal_n(header, yuv_h, params_len)) {
+        fprintf(stderr, "Video \"%s\" can't be resumed: its header doesn't match the frames being converted:\n"
+                        "\t%.*s\n", vid_path, (int) header_len, header);
+        abort();
+    }
+    ++header_len; // the newline
+    fseek(vid->fp, 0, SEEK_END);
+    size_t file_size = (size_t) ftell(vid->fp);
+    size_t record_size = frame_size + 6; // "FRAME\n" + the planes
+    size_t frames = 0;
+    size_t ckpt_bytes;
+    if (!read_checkpoint(ck, &frames, &ckpt_bytes) || ckpt_bytes != header_len + frames*record_size ||
+        ckpt_bytes > file_size)
+        frames = 0; // no checkpoint, or one for some other video
+    char marker[6];
+    for (size_t offset = header_len + frames*record_size; offset + record_size <= file_size; offset += record_size) {
+        fseek(vid->fp, (long) offset, SEEK_SET);
+        if (fread(marker, sizeof(char), 6, vid->fp) != 6 || !equal_n(marker, "FRAME\n", 6))
+            break;
+        ++frames;
+    }
+    vid->size = header_len + frames*record_size;
+    if (vid->size != file_size) { // a frame was being written when the conversion stopped
+        fflush(vid->fp);
+#ifdef _WIN32
+        if (_chsize_s(_fileno(vid->fp), (long long) vid->size)) {
+#else
+        if (ftruncate(fileno(vid->fp), (off_t) vid->size)) {
+#endif
+            fprintf(stderr, "Error truncating the partial frame at the end of video \"%s\".\n", vid_path);
+            perror("Error type");
+            abort();
+        }
+    }
+    fseek(vid->fp, (long) vid->size, SEEK_SET);
+    return frames;
+}
@@ -0,0 +1,240 @@
+//
+// finding the BMPs to convert - by scanning a directory or reading a list of them - & storing their paths in one block
+//
+
+#pragma once
+
+#include "filemap.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/syscall.h>
+#endif
+
+#define SCAN_BUF_SIZE (1 << 18) // size of the buffer getdents64() fills with directory entries in one go
+#define MIN_ARENA_SIZE 4096
+
+/* Each path found is appended to one growing arena of NUL-terminated strings, with only its offset recorded, so adding
+ * a path costs a copy rather than a malloc(). Once the scan is done, the offsets are turned into a NULL-terminated
+ * array of pointers, which is allocated together with the strings as one block, so the whole table is freed at once. */
+typedef struct {
+    char *arena;
+    size_t arena_len;
+    size_t arena_cap;
+    size_t *offsets; // offset of each path in the arena
+    size_t count;
+    size_t offsets_cap;
+} path_table;
+
+static void add_path(path_table *tbl, const char *dir, size_t dir_len, const char *name) {
+    size_t name_len = strlen_c(name);
+    size_t needed = tbl->arena_len + dir_len + name_len + 1;
+    if (needed > tbl->arena_cap) {
+        while (needed > tbl->arena_cap)
+            tbl->arena_cap *= 2;
+        tbl->arena = realloc(tbl->arena, tbl->arena_cap);
+    }
+    if (tbl->count == tbl->offsets_cap) {
+        tbl->offsets_cap *= 2;
+        tbl->offsets = realloc(tbl->offsets, tbl->offsets_cap*sizeof(size_t));
+    }
+    if (!tbl->arena || !tbl->offsets) {
+        fprintf(stderr, "Memory allocation error when scanning the directory.\n");
+        abort();
+    }
+    *(tbl->offsets + tbl->count++) = tbl->arena_len;
+    char *dst = tbl->arena + tbl->arena_len;
+    for (size_t i = 0; i < dir_len; ++i)
+        *dst++ = *(dir + i);
+    for (size_t i = 0; i <= name_len; ++i) // includes the null-terminator
+        *dst++ = *(name + i);
+    tbl->arena_len = needed;
+}
+
+/* returns a NULL-terminated array of the paths of all the .bmp files in dir_path (which must end in a file separator),
+ * in directory order, or NULL (with an error printed) if the directory can't be read - free()ing the array frees the
+ * paths too. *count is set to the number of paths found */
+const char **scan_bmps(const char *dir_path, size_t *count) {
+    size_t dir_len = strlen_c(dir_path);
+    path_table tbl;
+    tbl.arena_cap = MIN_ARENA_SIZE;
+    tbl.arena_len = 0;
+    tbl.arena = malloc(tbl.arena_cap);
+    tbl.offsets_cap = MIN_ARENA_SIZE/sizeof(size_t);
+    tbl.count = 0;
+    tbl.offsets = malloc(tbl.offsets_cap*sizeof(size_t));
+    if (!tbl.arena || !tbl.offsets) {
+        fprintf(stderr, "Memory allocation error when scanning the directory.\n");
+        abort();
+    }
+#ifdef _WIN32
+    char *pattern = malloc(dir_len + 6);
+    if (!pattern) {
+        fprintf(stderr, "Memory allocation error when scanning the directory.\n");
+        abort();
+    }
+    strcpy_c(pattern, dir_path);
+    strcat_c(pattern, "*.bmp");
+    WIN32_FIND_DATAA find = {0};
+    HANDLE first = FindFirstFileExA(pattern, FindExInfoBasic, &find, FindExSearchNameMatch, NULL,
+                                    FIND_FIRST_EX_LARGE_FETCH); // fetches entries in larger batches
+    free(pattern);
+    if (first != INVALID_HANDLE_VALUE) { // no matches is reported by the caller, like for an empty directory
+        do {
+            if (!(find.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+                add_path(&tbl, dir_path, dir_len, find.cFileName);
+        } while (FindNextFileA(first, &find) != 0);
+        FindClose(first);
+    }
+#elif defined(__linux__)
+    struct linux_dirent64 { // as filled in by getdents64(), which glibc has no wrapper for before 2.30
+        unsigned long long d_ino;
+        long long d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+    } *entry;
+    int fd = open(dir_path, O_RDONLY | O_DIRECTORY);
+    char *buf = malloc(SCAN_BUF_SIZE);
+    if (fd == -1 || !buf) {
+        fprintf(stderr, "Could not open directory.\n");
+        perror("Error");
+        if (fd != -1)
+            close(fd);
+        free_ptrs(3, buf, tbl.arena, tbl.offsets);
+        return NULL;
+    }
+    long num_read;
+    while ((num_read = syscall(SYS_getdents64, fd, buf, SCAN_BUF_SIZE)) > 0) { // many entries per system call
+        for (long pos = 0; pos < num_read; pos += entry->d_reclen) {
+            entry = (struct linux_dirent64 *) (buf + pos);
+            if (entry->d_type != DT_DIR && endswith(entry->d_name, ".bmp"))
+                add_path(&tbl, dir_path, dir_len, entry->d_name);
+        }
+    }
+    free(buf);
+    close(fd);
+    if (num_read == -1) {
+        fprintf(stderr, "Error reading directory.\n");
+        perror("Error");
+        free_ptrs(2, tbl.arena, tbl.offsets);
+        return NULL;
+    }
+#else
+    struct dirent *entry;
+    DIR *dir = opendir(dir_path);
+    if (dir == NULL) {
+        fprintf(stderr, "Could not open directory.\n");
+        perror("Error");
+        free_ptrs(2, tbl.arena, tbl.offsets);
+        return NULL;
+    }
+    while ((entry = readdir(dir)) != NULL)
+        if (endswith(entry->d_name, ".bmp"))
+            add_path(&tbl, dir_path, dir_len, entry->d_name);
+    closedir(dir);
+#endif
+    const char **array = malloc((tbl.count + 1)*sizeof(const char *) + tbl.arena_len);
+    if (!array) {
+        fprintf(stderr, "Memory allocation error when scanning the directory.\n");
+        abort();
+    }
+    char *strs = (char *) (array + tbl.count + 1); // the strings go straight after the pointers
+    for (size_t i = 0; i < tbl.arena_len; ++i)
+        *(strs + i) = *(tbl.arena + i);
+    for (size_t i = 0; i < tbl.count; ++i)
+        *(array + i) = strs + *(tbl.offsets + i);
+    *(array + tbl.count) = NULL;
+    *count = tbl.count;
+    free_ptrs(2, tbl.arena, tbl.offsets);
+    return array;
+}
+
+/* returns the ordered list of frame paths held in the file at list_path ("-" for stdin), in the same format as
+ * scan_bmps(). Entries are separated by NUL characters if there are any in the list (as with "find -print0"), or by
+ * newlines otherwise (with any "\r" before them dropped), and empty entries are ignored */
+const char **read_list(const char *list_path, size_t *count) {
+    file_map map = {0};
+    char *buf = NULL; // holds the list when read from stdin, which can't be mapped
+    const char *data;
+    size_t size = 0;
+    if (equal(list_path, "-")) {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY); // so NUL-separated lists & "\r\n" reach us unaltered
+#endif
+        size_t cap = MIN_ARENA_SIZE;
+        size_t num_read;
+        buf = malloc(cap);
+        while (buf && ((num_read = fread(buf + size, sizeof(char), cap - size, stdin)) > 0 ||
+                       (ferror(stdin) && errno == EINTR))) { // SIGINT only stops the conversion once it's started
+            clearerr(stdin);
+            size += num_read;
+            if (size == cap)
+                buf = realloc(buf, cap *= 2);
+        }
+        if (!buf) {
+            fprintf(stderr, "Memory allocation error when reading the frame list.\n");
+            abort();
+        }
+        data = buf;
+    }
+    else {
+        if (!map_file(&map, list_path)) {
+            fprintf(stderr, "Frame list \"%s\" could not be opened.\n", list_path);
+            perror("Error");
+            return NULL;
+        }
+        data = (const char *) map.data;
+        size = map.size;
+    }
+    const char *end = data + size;
+    char sep = '\n';
+    for (const char *ptr = data; ptr < end; ++ptr) {
+        if (!*ptr) {
+            sep = 0;
+            break;
+        }
+    }
+    size_t num = 0;
+    const char *ptr = data;
+    const char *entry_end;
+    while (ptr < end) { // first count the entries, so that the table can be allocated in one go
+        for (entry_end = ptr; entry_end < end && *entry_end != sep; ++entry_end);
+        if (entry_end > ptr && !(sep && entry_end - ptr == 1 && *ptr == '\r'))
+            ++num;
+        ptr = entry_end + 1;
+    }
+    const char **array = malloc((num + 1)*sizeof(const char *) + size + 1); // each separator becomes a terminator
+    if (!array) {
+        fprintf(stderr, "Memory allocation error when reading the frame list.\n");
+        abort();
+    }
+    char *dst = (char *) (array + num + 1);
+    size_t i = 0;
+    ptr = data;
+    while (ptr < end) {
+        for (entry_end = ptr; entry_end < end && *entry_end != sep; ++entry_end);
+        if (sep && entry_end > ptr && *(entry_end - 1) == '\r') // "\r\n" line endings
+            --entry_end;
+        if (entry_end > ptr) {
+            *(array + i++) = dst;
+            while (ptr < entry_end)
+                *dst++ = *ptr++;
+            *dst++ = 0;
+        }
+        for (; ptr < end && *ptr != sep; ++ptr); // skip past the separator (and any "\r" before it)
+        ++ptr;
+    }
+    *(array + num) = NULL;
+    *count = num;
+    if (buf)
+        free(buf);
+    else
+        unmap_file(&map);
+    return array;
+}
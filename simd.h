@@ -0,0 +1,838 @@
+//
+// vectorised (SSE2, AVX2 & AVX-512) versions of the colour sub-sampling kernels in overhead.h
+//
+
+#pragma once
+
+#include "lut.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define Y4M_X86
+#endif
+
+#ifdef Y4M_X86
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SSE2
+#define TARGET_AVX2
+#define TARGET_AVX512
+#else
+#include <cpuid.h>
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#endif
+
+/* All the kernels below work on 16 pixels per 128-bit lane: the 48 bytes of BGR triplets are split into 16 B, 16 G and
+ * 16 R bytes, widened to 16 bits, and each Y/Cb/Cr value (or sum of R, G & B values for the sub-sampled chroma) is
+ * computed with two multiply-adds of 16-bit coefficient pairs, using exactly the same fixed-point constants and
+ * rounding as the get_*_fx() functions - so the output is bit-for-bit identical to the scalar fixed-point kernels.
+ * Every instruction used operates within 128-bit lanes, so the wider versions just compute 2 (AVX2) or 4 (AVX-512)
+ * lanes side by side, and only the storing of the sub-sampled chroma needs to gather the results across lanes. */
+
+#define COEF_PAIR(lo, hi) ((int) (((unsigned int) (hi) << 16) | ((unsigned int) (lo) & 0xffff)))
+
+static const unsigned char deint_masks[3][3][16] = { // pshufb masks picking B, G & R out of 3 registers (0x80 -> 0)
+        {{0, 3, 6, 9, 12, 15, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128},
+         {128, 128, 128, 128, 128, 128, 2, 5, 8, 11, 14, 128, 128, 128, 128, 128},
+         {128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 1, 4, 7, 10, 13}},
+        {{1, 4, 7, 10, 13, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128},
+         {128, 128, 128, 128, 128, 0, 3, 6, 9, 12, 15, 128, 128, 128, 128, 128},
+         {128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 2, 5, 8, 11, 14}},
+        {{2, 5, 8, 11, 14, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128},
+         {128, 128, 128, 128, 128, 1, 4, 7, 10, 13, 128, 128, 128, 128, 128, 128},
+         {128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 0, 3, 6, 9, 12, 15}}
+};
+
+/* ---------------------------------------------------- SSE2 ---------------------------------------------------- */
+
+TARGET_SSE2 static inline void deint_sse2(const colour *ptr, __m128i *b, __m128i *g, __m128i *r) {
+    // SSE2 has no byte shuffle, so the triplets are separated with 4 rounds of byte interleaving instead
+    const unsigned char *p = (const unsigned char *) ptr;
+    __m128i t00 = _mm_loadu_si128((const __m128i *) p);
+    __m128i t01 = _mm_loadu_si128((const __m128i *) (p + 16));
+    __m128i t02 = _mm_loadu_si128((const __m128i *) (p + 32));
+    __m128i t10 = _mm_unpacklo_epi8(t00, _mm_unpackhi_epi64(t01, t01));
+    __m128i t11 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t00, t00), t02);
+    __m128i t12 = _mm_unpacklo_epi8(t01, _mm_unpackhi_epi64(t02, t02));
+    __m128i t20 = _mm_unpacklo_epi8(t10, _mm_unpackhi_epi64(t11, t11));
+    __m128i t21 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t10, t10), t12);
+    __m128i t22 = _mm_unpacklo_epi8(t11, _mm_unpackhi_epi64(t12, t12));
+    __m128i t30 = _mm_unpacklo_epi8(t20, _mm_unpackhi_epi64(t21, t21));
+    __m128i t31 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t20, t20), t22);
+    __m128i t32 = _mm_unpacklo_epi8(t21, _mm_unpackhi_epi64(t22, t22));
+    *b = _mm_unpacklo_epi8(t30, _mm_unpackhi_epi64(t31, t31));
+    *g = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t30, t30), t32);
+    *r = _mm_unpacklo_epi8(t31, _mm_unpackhi_epi64(t32, t32));
+}
+// computes 8 16-bit Y/Cb/Cr values from 8 16-bit R, G & B values (or sums of 2^k values, in which case they average)
+TARGET_SSE2 static inline __m128i transform_sse2(__m128i r, __m128i g, __m128i b, int rg_coefs, int b_coef, int k,
+                                                  short offset) {
+    const __m128i crg = _mm_set1_epi32(rg_coefs);
+    const __m128i cb = _mm_set1_epi32(COEF_PAIR(b_coef, FX_HALF)); // rounding constant multiplied by 2^k below
+    const __m128i count = _mm_set1_epi16((short) (1 << k));
+    __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(r, g), crg),
+                               _mm_madd_epi16(_mm_unpacklo_epi16(b, count), cb));
+    __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(r, g), crg),
+                               _mm_madd_epi16(_mm_unpackhi_epi16(b, count), cb));
+    lo = _mm_srai_epi32(lo, FX_SHIFT + k);
+    hi = _mm_srai_epi32(hi, FX_SHIFT + k);
+    return _mm_add_epi16(_mm_packs_epi32(lo, hi), _mm_set1_epi16(offset)); // offset is 128 for chroma
+}
+// transforms 16 8-bit R, G & B values into 16 8-bit values (packus saturates 256 to 255, like FX_CLAMP())
+TARGET_SSE2 static inline __m128i transform16_sse2(__m128i r, __m128i g, __m128i b, int rg_coefs, int b_coef,
+                                                    short offset) {
+    const __m128i zero = _mm_setzero_si128();
+    return _mm_packus_epi16(transform_sse2(_mm_unpacklo_epi8(r, zero), _mm_unpacklo_epi8(g, zero),
+                                           _mm_unpacklo_epi8(b, zero), rg_coefs, b_coef, 0, offset),
+                            transform_sse2(_mm_unpackhi_epi8(r, zero), _mm_unpackhi_epi8(g, zero),
+                                           _mm_unpackhi_epi8(b, zero), rg_coefs, b_coef, 0, offset));
+}
+
+TARGET_SSE2 static inline __m128i pairs_sse2(__m128i x) { // sums of horizontally adjacent bytes, as 16-bit values
+    return _mm_add_epi16(_mm_and_si128(x, _mm_set1_epi16(0xff)), _mm_srli_epi16(x, 8));
+}
+
+TARGET_SSE2 static inline __m128i quads_sse2(__m128i x) { // sums of adjacent 16-bit values, as 32-bit values
+    return _mm_add_epi32(_mm_and_si128(x, _mm_set1_epi32(0xffff)), _mm_srli_epi32(x, 16));
+}
+
+// sums of 4x2 blocks of bytes, from 2 blocks of pixels (a0, a1) & the 2 blocks in the row below them (b0, b1)
+TARGET_SSE2 static inline __m128i sums4x2_sse2(__m128i a0, __m128i a1, __m128i b0, __m128i b1) {
+    return _mm_packs_epi32(quads_sse2(_mm_add_epi16(pairs_sse2(a0), pairs_sse2(b0))),
+                           quads_sse2(_mm_add_epi16(pairs_sse2(a1), pairs_sse2(b1))));
+}
+
+TARGET_SSE2 static inline void store_cbcr_sse2(unsigned char *cb, unsigned char *cr, __m128i r, __m128i g, __m128i b,
+                                                int k) { // stores 8 Cb & Cr values from 8 16-bit R, G & B sums
+    __m128i w = transform_sse2(r, g, b, COEF_PAIR(FX_CB_R, FX_CB_G), FX_CB_B, k, 128);
+    _mm_storel_epi64((__m128i *) cb, _mm_packus_epi16(w, w));
+    w = transform_sse2(r, g, b, COEF_PAIR(FX_CR_R, FX_CR_G), FX_CR_B, k, 128);
+    _mm_storel_epi64((__m128i *) cr, _mm_packus_epi16(w, w));
+}
+
+TARGET_SSE2 void output_444_sse2(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                                 unsigned char *cr, unsigned int width, unsigned int height) {
+    __m128i b, g, r;
+    for (unsigned int j = 0; j < height; ++j, input = next_row(input, stride)) {
+        const colour *ptr = input;
+        unsigned int i = 0;
+        for (; i + 16 <= width; i += 16, ptr += 16) {
+            deint_sse2(ptr, &b, &g, &r);
+            _mm_storeu_si128((__m128i *) (luma + i), transform16_sse2(r, g, b, COEF_PAIR(FX_Y_R, FX_Y_G), FX_Y_B, 0));
+            _mm_storeu_si128((__m128i *) (cb + i), transform16_sse2(r, g, b, COEF_PAIR(FX_CB_R, FX_CB_G), FX_CB_B,
+                                                                    128));
+            _mm_storeu_si128((__m128i *) (cr + i), transform16_sse2(r, g, b, COEF_PAIR(FX_CR_R, FX_CR_G), FX_CR_B,
+                                                                    128));
+        }
+        for (; i < width; ++i, ++ptr) { // leftover pixels
+            luma[i] = get_Y_fx(*ptr);
+            cb[i] = get_Cb_fx(*ptr);
+            cr[i] = get_Cr_fx(*ptr);
+        }
+        luma += width;
+        cb += width;
+        cr += width;
+    }
+}
+
+TARGET_SSE2 void output_422_sse2(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                                 unsigned char *cr, unsigned int width, unsigned int height) {
+    __m128i b, g, r;
+    for (unsigned int j = 0; j < height; ++j, input = next_row(input, stride)) {
+        const colour *ptr = input;
+        unsigned int i = 0;
+        for (; i + 16 <= width; i += 16, ptr += 16) {
+            deint_sse2(ptr, &b, &g, &r);
+            _mm_storeu_si128((__m128i *) (luma + i), transform16_sse2(r, g, b, COEF_PAIR(FX_Y_R, FX_Y_G), FX_Y_B, 0));
+            store_cbcr_sse2(cb + i/2, cr + i/2, pairs_sse2(r), pairs_sse2(g), pairs_sse2(b), 1);
+        }
+        for (; i < width; i += 2, ptr += 2) {
+            luma[i] = get_Y_fx(*ptr);
+            luma[i + 1] = get_Y_fx(*(ptr + 1));
+            cb[i/2] = get_Cb_avg2_fx(*ptr, *(ptr + 1));
+            cr[i/2] = get_Cr_avg2_fx(*ptr, *(ptr + 1));
+        }
+        luma += width;
+        cb += width/2;
+        cr += width/2;
+    }
+}
+
+TARGET_SSE2 void output_420_sse2(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                                 unsigned char *cr, unsigned int width, unsigned int height) {
+    __m128i b, g, r, b2, g2, r2;
+    for (unsigned int j = 0; j < height; j += 2, input = next_row(input, 2*stride)) {
+        const colour *ptr = input;
+        const colour *nxt = next_row(ptr, stride); // row "below" ptr
+        unsigned char *y = luma + ((size_t) j)*width;
+        unsigned char *y2 = y + width;
+        unsigned int i = 0;
+        for (; i + 16 <= width; i += 16, ptr += 16, nxt += 16, cb += 8, cr += 8) {
+            deint_sse2(ptr, &b, &g, &r);
+            deint_sse2(nxt, &b2, &g2, &r2);
+            _mm_storeu_si128((__m128i *) (y + i), transform16_sse2(r, g, b, COEF_PAIR(FX_Y_R, FX_Y_G), FX_Y_B, 0));
+            _mm_storeu_si128((__m128i *) (y2 + i), transform16_sse2(r2, g2, b2, COEF_PAIR(FX_Y_R, FX_Y_G), FX_Y_B,
+                                                                    0));
+            store_cbcr_sse2(cb, cr, _mm_add_epi16(pairs_sse2(r), pairs_sse2(r2)),
+                            _mm_add_epi16(pairs_sse2(g), pairs_sse2(g2)),
+                            _mm_add_epi16(pairs_sse2(b), pairs_sse2(b2)), 2);
+        }
+        for (; i < width; i += 2, ptr += 2, nxt += 2) {
+            y[i] = get_Y_fx(*ptr);
+            y[i + 1] = get_Y_fx(*(ptr + 1));
+            y2[i] = get_Y_fx(*nxt);
+            y2[i + 1] = get_Y_fx(*(nxt + 1));
+            *cb++ = get_Cb_avg4_fx(*ptr, *(ptr + 1), *nxt, *(nxt + 1));
+            *cr++ = get_Cr_avg4_fx(*ptr, *(ptr + 1), *nxt, *(nxt + 1));
+        }
+    }
+}
+
+TARGET_SSE2 void output_411_sse2(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                                 unsigned char *cr, unsigned int width, unsigned int height) {
+    __m128i b, g, r, b2, g2, r2;
+    for (unsigned int j = 0; j < height; ++j, input = next_row(input, stride)) {
+        const colour *ptr = input;
+        unsigned int i = 0;
+        for (; i + 32 <= width; i += 32, ptr += 32) { // 2 blocks of 16, to have 8 chroma values to store
+            deint_sse2(ptr, &b, &g, &r);
+            deint_sse2(ptr + 16, &b2, &g2, &r2);
+            _mm_storeu_si128((__m128i *) (luma + i), transform16_sse2(r, g, b, COEF_PAIR(FX_Y_R, FX_Y_G), FX_Y_B, 0));
+            _mm_storeu_si128((__m128i *) (luma + i + 16), transform16_sse2(r2, g2, b2, COEF_PAIR(FX_Y_R, FX_Y_G),
+                                                                             FX_Y_B, 0));
+            store_cbcr_sse2(cb + i/4, cr + i/4, _mm_packs_epi32(quads_sse2(pairs_sse2(r)), quads_sse2(pairs_sse2(r2))),
+                            _mm_packs_epi32(quads_sse2(pairs_sse2(g)), quads_sse2(pairs_sse2(g2))),
+                            _mm_packs_epi32(quads_sse2(pairs_sse2(b)), quads_sse2(pairs_sse2(b2))), 2);
+        }
+        for (; i < width; i += 4, ptr += 4) {
+            for (unsigned int k = 0; k < 4; ++k)
+                luma[i + k] = get_Y_fx(*(ptr + k));
+            cb[i/4] = get_Cb_avg4_fx(*ptr, *(ptr + 1), *(ptr + 2), *(ptr + 3));
+            cr[i/4] = get_Cr_avg4_fx(*ptr, *(ptr + 1), *(ptr + 2), *(ptr + 3));
+        }
+        luma += width;
+        cb += width/4;
+        cr += width/4;
+    }
+}
+
+TARGET_SSE2 void output_410_sse2(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                                 unsigned char *cr, unsigned int width, unsigned int height) {
+    __m128i b[4], g[4], r[4]; // 2 blocks from each of the 2 rows
+    for (unsigned int j = 0; j < height; j += 2, input = next_row(input, 2*stride)) {
+        const colour *ptr = input;
+        const colour *nxt = next_row(ptr, stride);
+        unsigned char *y = luma + ((size_t) j)*width;
+        unsigned char *y2 = y + width;
+        unsigned int i = 0;
+        for (; i + 32 <= width; i += 32, ptr += 32, nxt += 32, cb += 8, cr += 8) {
+            deint_sse2(ptr, b, g, r);
+            deint_sse2(ptr + 16, b + 1, g + 1, r + 1);
+            deint_sse2(nxt, b + 2, g + 2, r + 2);
+            deint_sse2(nxt + 16, b + 3, g + 3, r + 3);
+            _mm_storeu_si128((__m128i *) (y + i), transform16_sse2(r[0], g[0], b[0], COEF_PAIR(FX_Y_R, FX_Y_G),
+                                                                   FX_Y_B, 0));
+            _mm_storeu_si128((__m128i *) (y + i + 16), transform16_sse2(r[1], g[1], b[1], COEF_PAIR(FX_Y_R, FX_Y_G),
+                                                                        FX_Y_B, 0));
+            _mm_storeu_si128((__m128i *) (y2 + i), transform16_sse2(r[2], g[2], b[2], COEF_PAIR(FX_Y_R, FX_Y_G),
+                                                                    FX_Y_B, 0));
+            _mm_storeu_si128((__m128i *) (y2 + i + 16), transform16_sse2(r[3], g[3], b[3], COEF_PAIR(FX_Y_R, FX_Y_G),
+                                                                         FX_Y_B, 0));
+            store_cbcr_sse2(cb, cr, sums4x2_sse2(r[0], r[1], r[2], r[3]), sums4x2_sse2(g[0], g[1], g[2], g[3]),
+                                    sums4x2_sse2(b[0], b[1], b[2], b[3]), 3);
+        }
+        for (; i < width; i += 4, ptr += 4, nxt += 4) {
+            for (unsigned int k = 0; k < 4; ++k) {
+                y[i + k] = get_Y_fx(*(ptr + k));
+                y2[i + k] = get_Y_fx(*(nxt + k));
+            }
+            *cb++ = get_Cb_avg8_fx(*ptr, *(ptr + 1), *(ptr + 2), *(ptr + 3), *nxt, *(nxt + 1), *(nxt + 2), *(nxt + 3));
+            *cr++ = get_Cr_avg8_fx(*ptr, *(ptr + 1), *(ptr + 2), *(ptr + 3), *nxt, *(nxt + 1), *(nxt + 2), *(nxt + 3));
+        }
+    }
+}
+
+/* ---------------------------------------------------- AVX2 ---------------------------------------------------- */
+
+TARGET_AVX2 static inline __m256i load2x128_avx2(const unsigned char *p) { // p -> lower lane, p + 48 -> upper lane
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) p)),
+                                   _mm_loadu_si128((const __m128i *) (p + 48)), 1);
+}
+
+TARGET_AVX2 static inline __m256i shuffle3_avx2(__m256i a, __m256i b, __m256i c, const unsigned char (*m)[16]) {
+    return _mm256_or_si256(_mm256_or_si256(
+            _mm256_shuffle_epi8(a, _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) m[0]))),
+            _mm256_shuffle_epi8(b, _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) m[1])))),
+            _mm256_shuffle_epi8(c, _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) m[2]))));
+}
+
+TARGET_AVX2 static inline void deint_avx2(const colour *ptr, __m256i *b, __m256i *g, __m256i *r) { // 32 pixels
+    const unsigned char *p = (const unsigned char *) ptr;
+    __m256i x = load2x128_avx2(p);
+    __m256i y = load2x128_avx2(p + 16);
+    __m256i z = load2x128_avx2(p + 32);
+    *b = shuffle3_avx2(x, y, z, deint_masks[0]);
+    *g = shuffle3_avx2(x, y, z, deint_masks[1]);
+    *r = shuffle3_avx2(x, y, z, deint_masks[2]);
+}
+
+TARGET_AVX2 static inline __m256i transform_avx2(__m256i r, __m256i g, __m256i b, int rg_coefs, int b_coef, int k,
+                                                  short offset) {
+    const __m256i crg = _mm256_set1_epi32(rg_coefs);
+    const __m256i cb = _mm256_set1_epi32(COEF_PAIR(b_coef, FX_HALF));
+    const __m256i count = _mm256_set1_epi16((short) (1 << k));
+    __m256i lo = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(r, g), crg),
+                                  _mm256_madd_epi16(_mm256_unpacklo_epi16(b, count), cb));
+    __m256i hi = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(r, g), crg),
+                                  _mm256_madd_epi16(_mm256_unpackhi_epi16(b, count), cb));
+    lo = _mm256_srai_epi32(lo, FX_SHIFT + k);
+    hi = _mm256_srai_epi32(hi, FX_SHIFT + k);
+    return _mm256_add_epi16(_mm256_packs_epi32(lo, hi), _mm256_set1_epi16(offset));
+}
+
+TARGET_AVX2 static inline __m256i transform32_avx2(__m256i r, __m256i g, __m256i b, int rg_coefs, int b_coef,
+                                                    short offset) {
+    const __m256i zero = _mm256_setzero_si256();
+    return _mm256_packus_epi16(transform_avx2(_mm256_unpacklo_epi8(r, zero), _mm256_unpacklo_epi8(g, zero),
+                                              _mm256_unpacklo_epi8(b, zero), rg_coefs, b_coef, 0, offset),
+                               transform_avx2(_mm256_unpackhi_epi8(r, zero), _mm256_unpackhi_epi8(g, zero),
+                                              _mm256_unpackhi_epi8(b, zero), rg_coefs, b_coef, 0, offset));
+}
+
+TARGET_AVX2 static inline __m256i pairs_avx2(__m256i x) {
+    return _mm256_add_epi16(_mm256_and_si256(x, _mm256_set1_epi16(0xff)), _mm256_srli_epi16(x, 8));
+}
+
+TARGET_AVX2 static inline __m256i quads_avx2(__m256i x) {
+    return _mm256_add_epi32(_mm256_and_si256(x, _mm256_set1_epi32(0xffff)), _mm256_srli_epi32(x, 16));
+}
+
+TARGET_AVX2 static inline __m256i sums4x2_avx2(__m256i a0, __m256i a1, __m256i b0, __m256i b1) {
+    return _mm256_packs_epi32(quads_avx2(_mm256_add_epi16(pairs_avx2(a0), pairs_avx2(b0))),
+                              quads_avx2(_mm256_add_epi16(pairs_avx2(a1), pairs_avx2(b1))));
+}
+/* stores 16 Cb & Cr values - the 8 values computed in each lane end up in its lower half, so if the sums came from a
+ * single block of 32 pixels, the lower 64 bits of each lane are what's needed, but if they came from two blocks
+ * (packed together), the first 32 bits of each lane belong to the first block and the next 32 to the second one */
+TARGET_AVX2 static inline void store_cbcr_avx2(unsigned char *cb, unsigned char *cr, __m256i r, __m256i g, __m256i b,
+                                               int k, bool two_blocks) {
+    const __m256i order = two_blocks ? _mm256_setr_epi32(0, 4, 1, 5, 0, 0, 0, 0) :
+                          _mm256_setr_epi32(0, 1, 4, 5, 0, 0, 0, 0);
+    __m256i w = transform_avx2(r, g, b, COEF_PAIR(FX_CB_R, FX_CB_G), FX_CB_B, k, 128);
+    w = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(w, w), order);
+    _mm_storeu_si128((__m128i *) cb, _mm256_castsi256_si128(w));
+    w = transform_avx2(r, g, b, COEF_PAIR(FX_CR_R, FX_CR_G), FX_CR_B, k, 128);
+    w = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(w, w), order);
+    _mm_storeu_si128((__m128i *) cr, _mm256_castsi256_si128(w));
+}
+
+TARGET_AVX2 void output_444_avx2(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                                 unsigned char *cr, unsigned int width, unsigned int height) {
+    __m256i b, g, r;
+    for (unsigned int j = 0; j < height; ++j, input = next_row(input, stride)) {
+        const colour *ptr = input;
+        unsigned int i = 0;
+        for (; i + 32 <= width; i += 32, ptr += 32) {
+            deint_avx2(ptr, &b, &g, &r);
+            _mm256_storeu_si256((__m256i *) (luma + i), transform32_avx2(r, g, b, COEF_PAIR(FX_Y_R, FX_Y_G), FX_Y_B,
+                                                                           0));
+            _mm256_storeu_si256((__m256i *) (cb + i), transform32_avx2(r, g, b, COEF_PAIR(FX_CB_R, FX_CB_G), FX_CB_B,
+                                                                       128));
+            _mm256_storeu_si256((__m256i *) (cr + i), transform32_avx2(r, g, b, COEF_PAIR(FX_CR_R, FX_CR_G), FX_CR_B,
+                                                                       128));
+        }
+        for (; i < width; ++i, ++ptr) {
+            luma[i] = get_Y_fx(*ptr);
+            cb[i] = get_Cb_fx(*ptr);
+            cr[i] = get_Cr_fx(*ptr);
+        }
+        luma += width;
+        cb += width;
+        cr += width;
+    }
+}
+
+TARGET_AVX2 void output_422_avx2(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                                 unsigned char *cr, unsigned int width, unsigned int height) {
+    __m256i b, g, r;
+    for (unsigned int j = 0; j < height; ++j, input = next_row(input, stride)) {
+        const colour *ptr = input;
+        unsigned int i = 0;
+        for (; i + 32 <= width; i += 32, ptr += 32) {
+            deint_avx2(ptr, &b, &g, &r);
+            _mm256_storeu_si256((__m256i *) (luma + i), transform32_avx2(r, g, b, COEF_PAIR(FX_Y_R, FX_Y_G), FX_Y_B,
+                                                                           0));
+            store_cbcr_avx2(cb + i/2, cr + i/2, pairs_avx2(r), pairs_avx2(g), pairs_avx2(b), 1, false);
+        }
+        for (; i < width; i += 2, ptr += 2) {
+            luma[i] = get_Y_fx(*ptr);
+            luma[i + 1] = get_Y_fx(*(ptr + 1));
+            cb[i/2] = get_Cb_avg2_fx(*ptr, *(ptr + 1));
+            cr[i/2] = get_Cr_avg2_fx(*ptr, *(ptr + 1));
+        }
+        luma += width;
+        cb += width/2;
+        cr += width/2;
+    }
+}
+
+TARGET_AVX2 void output_420_avx2(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                                 unsigned char *cr, unsigned int width, unsigned int height) {
+    __m256i b, g, r, b2, g2, r2;
+    for (unsigned int j = 0; j < height; j += 2, input = next_row(input, 2*stride)) {
+        const colour *ptr = input;
+        const colour *nxt = next_row(ptr, stride);
+        unsigned char *y = luma + ((size_t) j)*width;
+        unsigned char *y2 = y + width;
+        unsigned int i = 0;
+        for (; i + 32 <= width; i += 32, ptr += 32, nxt += 32, cb += 16, cr += 16) {
+            deint_avx2(ptr, &b, &g, &r);
+            deint_avx2(nxt, &b2, &g2, &r2);
+            _mm256_storeu_si256((__m256i *) (y + i), transform32_avx2(r, g, b, COEF_PAIR(FX_Y_R, FX_Y_G), FX_Y_B,
+                                                                      0));
+            _mm256_storeu_si256((__m256i *) (y2 + i), transform32_avx2(r2, g2, b2, COEF_PAIR(FX_Y_R, FX_Y_G),
+                                                                       FX_Y_B, 0));
+            store_cbcr_avx2(cb, cr, _mm256_add_epi16(pairs_avx2(r), pairs_avx2(r2)),
+                            _mm256_add_epi16(pairs_avx2(g), pairs_avx2(g2)),
+                            _mm256_add_epi16(pairs_avx2(b), pairs_avx2(b2)), 2, false);
+        }
+        for (; i < width; i += 2, ptr += 2, nxt += 2) {
+            y[i] = get_Y_fx(*ptr);
+            y[i + 1] = get_Y_fx(*(ptr + 1));
+            y2[i] = get_Y_fx(*nxt);
+            y2[i + 1] = get_Y_fx(*(nxt + 1));
+            *cb++ = get_Cb_avg4_fx(*ptr, *(ptr + 1), *nxt, *(nxt + 1));
+            *cr++ = get_Cr_avg4_fx(*ptr, *(ptr + 1), *nxt, *(nxt + 1));
+        }
+    }
+}
+
+TARGET_AVX2 void output_411_avx2(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                                 unsigned char *cr, unsigned int width, unsigned int height) {
+    __m256i b, g, r, b2, g2, r2;
+    for (unsigned int j = 0; j < height; ++j, input = next_row(input, stride)) {
+        const colour *ptr = input;
+        unsigned int i = 0;
+        for (; i + 64 <= width; i += 64, ptr += 64) {
+            deint_avx2(ptr, &b, &g, &r);
+            deint_avx2(ptr + 32, &b2, &g2, &r2);
+            _mm256_storeu_si256((__m256i *) (luma + i), transform32_avx2(r, g, b, COEF_PAIR(FX_Y_R, FX_Y_G), FX_Y_B,
+                                                                           0));
+            _mm256_storeu_si256((__m256i *) (luma + i + 32), transform32_avx2(r2, g2, b2, COEF_PAIR(FX_Y_R, FX_Y_G),
+                                                                                FX_Y_B, 0));
+            store_cbcr_avx2(cb + i/4, cr + i/4,
+                            _mm256_packs_epi32(quads_avx2(pairs_avx2(r)), quads_avx2(pairs_avx2(r2))),
+                            _mm256_packs_epi32(quads_avx2(pairs_avx2(g)), quads_avx2(pairs_avx2(g2))),
+                            _mm256_packs_epi32(quads_avx2(pairs_avx2(b)), quads_avx2(pairs_avx2(b2))), 2, true);
+        }
+        for (; i < width; i += 4, ptr += 4) {
+            for (unsigned int k = 0; k < 4; ++k)
+                luma[i + k] = get_Y_fx(*(ptr + k));
+            cb[i/4] = get_Cb_avg4_fx(*ptr, *(ptr + 1), *(ptr + 2), *(ptr + 3));
+            cr[i/4] = get_Cr_avg4_fx(*ptr, *(ptr + 1), *(ptr + 2), *(ptr + 3));
+        }
+        luma += width;
+        cb += width/4;
+        cr += width/4;
+    }
+}
+
+TARGET_AVX2 void output_410_avx2(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                                 unsigned char *cr, unsigned int width, unsigned int height) {
+    __m256i b[4], g[4], r[4];
+    for (unsigned int j = 0; j < height; j += 2, input = next_row(input, 2*stride)) {
+        const colour *ptr = input;
+        const colour *nxt = next_row(ptr, stride);
+        unsigned char *y = luma + ((size_t) j)*width;
+        unsigned char *y2 = y + width;
+        unsigned int i = 0;
+        for (; i + 64 <= width; i += 64, ptr += 64, nxt += 64, cb += 16, cr += 16) {
+            deint_avx2(ptr, b, g, r);
+            deint_avx2(ptr + 32, b + 1, g + 1, r + 1);
+            deint_avx2(nxt, b + 2, g + 2, r + 2);
+            deint_avx2(nxt + 32, b + 3, g + 3, r + 3);
+            _mm256_storeu_si256((__m256i *) (y + i), transform32_avx2(r[0], g[0], b[0], COEF_PAIR(FX_Y_R, FX_Y_G),
+                                                                      FX_Y_B, 0));
+            _mm256_storeu_si256((__m256i *) (y + i + 32), transform32_avx2(r[1], g[1], b[1],
+                                                                           COEF_PAIR(FX_Y_R, FX_Y_G), FX_Y_B, 0));
+            _mm256_storeu_si256((__m256i *) (y2 + i), transform32_avx2(r[2], g[2], b[2], COEF_PAIR(FX_Y_R, FX_Y_G),
+                                                                       FX_Y_B, 0));
+            _mm256_storeu_si256((__m256i *) (y2 + i + 32), transform32_avx2(r[3], g[3], b[3],
+                                                                            COEF_PAIR(FX_Y_R, FX_Y_G), FX_Y_B, 0));
+            store_cbcr_avx2(cb, cr, sums4x2_avx2(r[0], r[1], r[2], r[3]), sums4x2_avx2(g[0], g[1], g[2], g[3]),
+                                    sums4x2_avx2(b[0], b[1], b[2], b[3]), 3, true);
+        }
+        for (; i < width; i += 4, ptr += 4, nxt += 4) {
+            for (unsigned int k = 0; k < 4; ++k) {
+                y[i + k] = get_Y_fx(*(ptr + k));
+                y2[i + k] = get_Y_fx(*(nxt + k));
+            }
+            *cb++ = get_Cb_avg8_fx(*ptr, *(ptr + 1), *(ptr + 2), *(ptr + 3), *nxt, *(nxt + 1), *(nxt + 2), *(nxt + 3));
+            *cr++ = get_Cr_avg8_fx(*ptr, *(ptr + 1), *(ptr + 2), *(ptr + 3), *nxt, *(nxt + 1), *(nxt + 2), *(nxt + 3));
+        }
+    }
+}
+
+/* -------------------------------------------------- AVX-512 -------------------------------------------------- */
+
+TARGET_AVX512 static inline __m512i load4x128_avx512(const unsigned char *p) { // lanes from p, p+48, p+96 & p+144
+    __m512i v = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i *) p));
+    v = _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i *) (p + 48)), 1);
+    v = _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i *) (p + 96)), 2);
+    return _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i *) (p + 144)), 3);
+}
+
+TARGET_AVX512 static inline __m512i shuffle3_avx512(__m512i a, __m512i b, __m512i c, const unsigned char (*m)[16]) {
+    return _mm512_or_si512(_mm512_or_si512(
+            _mm512_shuffle_epi8(a, _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *) m[0]))),
+            _mm512_shuffle_epi8(b, _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *) m[1])))),
+            _mm512_shuffle_epi8(c, _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *) m[2]))));
+}
+
+TARGET_AVX512 static inline void deint_avx512(const colour *ptr, __m512i *b, __m512i *g, __m512i *r) { // 64 pixels
+    const unsigned char *p = (const unsigned char *) ptr;
+    __m512i x = load4x128_avx512(p);
+    __m512i y = load4x128_avx512(p + 16);
+    __m512i z = load4x128_avx512(p + 32);
+    *b = shuffle3_avx512(x, y, z, deint_masks[0]);
+    *g = shuffle3_avx512(x, y, z, deint_masks[1]);
+    *r = shuffle3_avx512(x, y, z, deint_masks[2]);
+}
+
+TARGET_AVX512 static inline __m512i transform_avx512(__m512i r, __m512i g, __m512i b, int rg_coefs, int b_coef,
+                                                      int k, short offset) {
+    const __m512i crg = _mm512_set1_epi32(rg_coefs);
+    const __m512i cb = _mm512_set1_epi32(COEF_PAIR(b_coef, FX_HALF));
+    const __m512i count = _mm512_set1_epi16((short) (1 << k));
+    __m512i lo = _mm512_add_epi32(_mm512_madd_epi16(_mm512_unpacklo_epi16(r, g), crg),
+                                  _mm512_madd_epi16(_mm512_unpacklo_epi16(b, count), cb));
+    __m512i hi = _mm512_add_epi32(_mm512_madd_epi16(_mm512_unpackhi_epi16(r, g), crg),
+                                  _mm512_madd_epi16(_mm512_unpackhi_epi16(b, count), cb));
+    lo = _mm512_srai_epi32(lo, FX_SHIFT + k);
+    hi = _mm512_srai_epi32(hi, FX_SHIFT + k);
+    return _mm512_add_epi16(_mm512_packs_epi32(lo, hi), _mm512_set1_epi16(offset));
+}
+
+TARGET_AVX512 static inline __m512i transform64_avx512(__m512i r, __m512i g, __m512i b, int rg_coefs, int b_coef,
+                                                        short offset) {
+    const __m512i zero = _mm512_setzero_si512();
+    return _mm512_packus_epi16(transform_avx512(_mm512_unpacklo_epi8(r, zero), _mm512_unpacklo_epi8(g, zero),
+                                                _mm512_unpacklo_epi8(b, zero), rg_coefs, b_coef, 0, offset),
+                               transform_avx512(_mm512_unpackhi_epi8(r, zero), _mm512_unpackhi_epi8(g, zero),
+                                                _mm512_unpackhi_epi8(b, zero), rg_coefs, b_coef, 0, offset));
+}
+
+TARGET_AVX512 static inline __m512i pairs_avx512(__m512i x) {
+    return _mm512_add_epi16(_mm512_and_si512(x, _mm512_set1_epi16(0xff)), _mm512_srli_epi16(x, 8));
+}
+
+TARGET_AVX512 static inline __m512i quads_avx512(__m512i x) {
+    return _mm512_add_epi32(_mm512_and_si512(x, _mm512_set1_epi32(0xffff)), _mm512_srli_epi32(x, 16));
+}
+
+TARGET_AVX512 static inline __m512i sums4x2_avx512(__m512i a0, __m512i a1, __m512i b0, __m512i b1) {
+    return _mm512_packs_epi32(quads_avx512(_mm512_add_epi16(pairs_avx512(a0), pairs_avx512(b0))),
+                              quads_avx512(_mm512_add_epi16(pairs_avx512(a1), pairs_avx512(b1))));
+}
+
+TARGET_AVX512 static inline void store_cbcr_avx512(unsigned char *cb, unsigned char *cr, __m512i r, __m512i g,
+                                                   __m512i b, int k, bool two_blocks) { // same idea as with AVX2
+    const __m512i order = two_blocks ? _mm512_setr_epi32(0, 4, 8, 12, 1, 5, 9, 13, 0, 0, 0, 0, 0, 0, 0, 0) :
+                          _mm512_setr_epi32(0, 1, 4, 5, 8, 9, 12, 13, 0, 0, 0, 0, 0, 0, 0, 0);
+    __m512i w = transform_avx512(r, g, b, COEF_PAIR(FX_CB_R, FX_CB_G), FX_CB_B, k, 128);
+    w = _mm512_permutexvar_epi32(order, _mm512_packus_epi16(w, w));
+    _mm256_storeu_si256((__m256i *) cb, _mm512_castsi512_si256(w));
+    w = transform_avx512(r, g, b, COEF_PAIR(FX_CR_R, FX_CR_G), FX_CR_B, k, 128);
+    w = _mm512_permutexvar_epi32(order, _mm512_packus_epi16(w, w));
+    _mm256_storeu_si256((__m256i *) cr, _mm512_castsi512_si256(w));
+}
+
+TARGET_AVX512 void output_444_avx512(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                                     unsigned char *cr, unsigned int width, unsigned int height) {
+    __m512i b, g, r;
+    for (unsigned int j = 0; j < height; ++j, input = next_row(input, stride)) {
+        const colour *ptr = input;
+        unsigned int i = 0;
+        for (; i + 64 <= width; i += 64, ptr += 64) {
+            deint_avx512(ptr, &b, &g, &r);
+            _mm512_storeu_si512(luma + i, transform64_avx512(r, g, b, COEF_PAIR(FX_Y_R, FX_Y_G), FX_Y_B, 0));
+            _mm512_storeu_si512(cb + i, transform64_avx512(r, g, b, COEF_PAIR(FX_CB_R, FX_CB_G), FX_CB_B, 128));
+            _mm512_storeu_si512(cr + i, transform64_avx512(r, g, b, COEF_PAIR(FX_CR_R, FX_CR_G), FX_CR_B, 128));
+        }
+        for (; i < width; ++i, ++ptr) {
+            luma[i] = get_Y_fx(*ptr);
+            cb[i] = get_Cb_fx(*ptr);
+            cr[i] = get_Cr_fx(*ptr);
+        }
+        luma += width;
+        cb += width;
+        cr += width;
+    }
+}
+
+TARGET_AVX512 void output_422_avx512(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                                     unsigned char *cr, unsigned int width, unsigned int height) {
+    __m512i b, g, r;
+    for (unsigned int j = 0; j < height; ++j, input = next_row(input, stride)) {
+        const colour *ptr = input;
+        unsigned int i = 0;
+        for (; i + 64 <= width; i += 64, ptr += 64) {
+            deint_avx512(ptr, &b, &g, &r);
+            _mm512_storeu_si512(luma + i, transform64_avx512(r, g, b, COEF_PAIR(FX_Y_R, FX_Y_G), FX_Y_B, 0));
+            store_cbcr_avx512(cb + i/2, cr + i/2, pairs_avx512(r), pairs_avx512(g), pairs_avx512(b), 1, false);
+        }
+        for (; i < width; i += 2, ptr += 2) {
+            luma[i] = get_Y_fx(*ptr);
+            luma[i + 1] = get_Y_fx(*(ptr + 1));
+            cb[i/2] = get_Cb_avg2_fx(*ptr, *(ptr + 1));
+            cr[i/2] = get_Cr_avg2_fx(*ptr, *(ptr + 1));
+        }
+        luma += width;
+        cb += width/2;
+        cr += width/2;
+    }
+}
+
+TARGET_AVX512 void output_420_avx512(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                                     unsigned char *cr, unsigned int width, unsigned int height) {
+    __m512i b, g, r, b2, g2, r2;
+    for (unsigned int j = 0; j < height; j += 2, input = next_row(input, 2*stride)) {
+        const colour *ptr = input;
+        const colour *nxt = next_row(ptr, stride);
+        unsigned char *y = luma + ((size_t) j)*width;
+        unsigned char *y2 = y + width;
+        unsigned int i = 0;
+        for (; i + 64 <= width; i += 64, ptr += 64, nxt += 64, cb += 32, cr += 32) {
+            deint_avx512(ptr, &b, &g, &r);
+            deint_avx512(nxt, &b2, &g2, &r2);
+            _mm512_storeu_si512(y + i, transform64_avx512(r, g, b, COEF_PAIR(FX_Y_R, FX_Y_G), FX_Y_B, 0));
+            _mm512_storeu_si512(y2 + i, transform64_avx512(r2, g2, b2, COEF_PAIR(FX_Y_R, FX_Y_G), FX_Y_B, 0));
+            store_cbcr_avx512(cb, cr, _mm512_add_epi16(pairs_avx512(r), pairs_avx512(r2)),
+                              _mm512_add_epi16(pairs_avx512(g), pairs_avx512(g2)),
+                              _mm512_add_epi16(pairs_avx512(b), pairs_avx512(b2)), 2, false);
+        }
+        for (; i < width; i += 2, ptr += 2, nxt += 2) {
+            y[i] = get_Y_fx(*ptr);
+            y[i + 1] = get_Y_fx(*(ptr + 1));
+            y2[i] = get_Y_fx(*nxt);
+            y2[i + 1] = get_Y_fx(*(nxt + 1));
+            *cb++ = get_Cb_avg4_fx(*ptr, *(ptr + 1), *nxt, *(nxt + 1));
+            *cr++ = get_Cr_avg4_fx(*ptr, *(ptr + 1), *nxt, *(nxt + 1));
+        }
+    }
+}
+
+TARGET_AVX512 void output_411_avx512(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                                     unsigned char *cr, unsigned int width, unsigned int height) {
+    __m512i b, g, r, b2, g2, r2;
+    for (unsigned int j = 0; j < height; ++j, input = next_row(input, stride)) {
+        const colour *ptr = input;
+        unsigned int i = 0;
+        for (; i + 128 <= width; i += 128, ptr += 128) {
+            deint_avx512(ptr, &b, &g, &r);
+            deint_avx512(ptr + 64, &b2, &g2, &r2);
+            _mm512_storeu_si512(luma + i, transform64_avx512(r, g, b, COEF_PAIR(FX_Y_R, FX_Y_G), FX_Y_B, 0));
+            _mm512_storeu_si512(luma + i + 64, transform64_avx512(r2, g2, b2, COEF_PAIR(FX_Y_R, FX_Y_G), FX_Y_B, 0));
+            store_cbcr_avx512(cb + i/4, cr + i/4,
+                              _mm512_packs_epi32(quads_avx512(pairs_avx512(r)), quads_avx512(pairs_avx512(r2))),
+                              _mm512_packs_epi32(quads_avx512(pairs_avx512(g)), quads_avx512(pairs_avx512(g2))),
+                              _mm512_packs_epi32(quads_avx512(pairs_avx512(b)), quads_avx512(pairs_avx512(b2))), 2,
+                              true);
+        }
+        for (; i < width; i += 4, ptr += 4) {
+            for (unsigned int k = 0; k < 4; ++k)
+                luma[i + k] = get_Y_fx(*(ptr + k));
+            cb[i/4] = get_Cb_avg4_fx(*ptr, *(ptr + 1), *(ptr + 2), *(ptr + 3));
+            cr[i/4] = get_Cr_avg4_fx(*ptr, *(ptr + 1), *(ptr + 2), *(ptr + 3));
+        }
+        luma += width;
+        cb += width/4;
+        cr += width/4;
+    }
+}
+
+TARGET_AVX512 void output_410_avx512(const colour *input, ptrdiff_t stride, unsigned char *luma, unsigned char *cb,
+                                     unsigned char *cr, unsigned int width, unsigned int height) {
+    __m512i b[4], g[4], r[4];
+    for (unsigned int j = 0; j < height; j += 2, input = next_row(input, 2*stride)) {
+        const colour *ptr = input;
+        const colour *nxt = next_row(ptr, stride);
+        unsigned char *y = luma + ((size_t) j)*width;
+        unsigned char *y2 = y + width;
+        unsigned int i = 0;
+        for (; i + 128 <= width; i += 128, ptr += 128, nxt += 128, cb += 32, cr += 32) {
+            deint_avx512(ptr, b, g, r);
+            deint_avx512(ptr + 64, b + 1, g + 1, r + 1);
+            deint_avx512(nxt, b + 2, g + 2, r + 2);
+            deint_avx512(nxt + 64, b + 3, g + 3, r + 3);
+            _mm512_storeu_si512(y + i, transform64_avx512(r[0], g[0], b[0], COEF_PAIR(FX_Y_R, FX_Y_G), FX_Y_B, 0));
+            _mm512_storeu_si512(y + i + 64, transform64_avx512(r[1], g[1], b[1], COEF_PAIR(FX_Y_R, FX_Y_G), FX_Y_B,
+                                                               0));
+            _mm512_storeu_si512(y2 + i, transform64_avx512(r[2], g[2], b[2], COEF_PAIR(FX_Y_R, FX_Y_G), FX_Y_B, 0));
+            _mm512_storeu_si512(y2 + i + 64, transform64_avx512(r[3], g[3], b[3], COEF_PAIR(FX_Y_R, FX_Y_G), FX_Y_B,
+                                                                0));
+            store_cbcr_avx512(cb, cr, sums4x2_avx512(r[0], r[1], r[2], r[3]), sums4x2_avx512(g[0], g[1], g[2], g[3]),
+                                      sums4x2_avx512(b[0], b[1], b[2], b[3]), 3, true);
+        }
+        for (; i < width; i += 4, ptr += 4, nxt += 4) {
+            for (unsigned int k = 0; k < 4; ++k) {
+                y[i + k] = get_Y_fx(*(ptr + k));
+                y2[i + k] = get_Y_fx(*(nxt + k));
+            }
+            *cb++ = get_Cb_avg8_fx(*ptr, *(ptr + 1), *(ptr + 2), *(ptr + 3), *nxt, *(nxt + 1), *(nxt + 2), *(nxt + 3));
+            *cr++ = get_Cr_avg8_fx(*ptr, *(ptr + 1), *(ptr + 2), *(ptr + 3), *nxt, *(nxt + 1), *(nxt + 2), *(nxt + 3));
+        }
+    }
+}
+
+/* ------------------------------------------------ tile diffs ------------------------------------------------ */
+
+/* The tile diffs compare 4 tiles (192 bytes) at a time, building a mask with a bit per byte that differs, 64 bytes
+ * at a time - each tile's 48 bits then straddle those masks in a fixed pattern. The rest of a row is compared with
+ * diff_tiles(), so that the last tile can be narrower. */
+#define DIFF_BLOCK (4*TILE_SIZE*sizeof(colour))
+
+static inline void flag_tiles(unsigned char *dirty, unsigned long long m0, unsigned long long m1,
+                              unsigned long long m2) { // m0-m2: the masks of the 3 64-byte parts of 4 tiles
+    *dirty |= (m0 & 0xffffffffffffull) != 0;
+    *(dirty + 1) |= ((m0 >> 48) | (m1 & 0xffffffffull)) != 0;
+    *(dirty + 2) |= ((m1 >> 32) | (m2 & 0xffffull)) != 0;
+    *(dirty + 3) |= (m2 >> 16) != 0;
+}
+
+TARGET_SSE2 static inline unsigned long long diff_mask_sse2(const unsigned char *a, const unsigned char *b) {
+    unsigned long long mask = 0;
+    for (int i = 0; i < 4; ++i) {
+        __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (a + 16*i)),
+                                    _mm_loadu_si128((const __m128i *) (b + 16*i)));
+        mask |= (unsigned long long) (unsigned int) _mm_movemask_epi8(eq) << 16*i;
+    }
+    return ~mask;
+}
+
+TARGET_SSE2 void diff_tiles_sse2(const unsigned char *a, const unsigned char *b, size_t bytes, unsigned char *dirty) {
+    size_t x = 0;
+    for (; x + DIFF_BLOCK <= bytes; x += DIFF_BLOCK, dirty += 4)
+        flag_tiles(dirty, diff_mask_sse2(a + x, b + x), diff_mask_sse2(a + x + 64, b + x + 64),
+                   diff_mask_sse2(a + x + 128, b + x + 128));
+    diff_tiles(a + x, b + x, bytes - x, dirty);
+}
+
+TARGET_AVX2 static inline unsigned long long diff_mask_avx2(const unsigned char *a, const unsigned char *b) {
+    __m256i eq0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) a), _mm256_loadu_si256((const __m256i *) b));
+    __m256i eq1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (a + 32)),
+                                    _mm256_loadu_si256((const __m256i *) (b + 32)));
+    return ~((unsigned long long) (unsigned int) _mm256_movemask_epi8(eq0) |
+             (unsigned long long) (unsigned int) _mm256_movemask_epi8(eq1) << 32);
+}
+
+TARGET_AVX2 void diff_tiles_avx2(const unsigned char *a, const unsigned char *b, size_t bytes, unsigned char *dirty) {
+    size_t x = 0;
+    for (; x + DIFF_BLOCK <= bytes; x += DIFF_BLOCK, dirty += 4)
+        flag_tiles(dirty, diff_mask_avx2(a + x, b + x), diff_mask_avx2(a + x + 64, b + x + 64),
+                   diff_mask_avx2(a + x + 128, b + x + 128));
+    diff_tiles(a + x, b + x, bytes - x, dirty);
+}
+
+TARGET_AVX512 static inline unsigned long long diff_mask_avx512(const unsigned char *a, const unsigned char *b) {
+    return _mm512_cmpneq_epi8_mask(_mm512_loadu_si512(a), _mm512_loadu_si512(b));
+}
+
+TARGET_AVX512 void diff_tiles_avx512(const unsigned char *a, const unsigned char *b, size_t bytes,
+                                     unsigned char *dirty) {
+    size_t x = 0;
+    for (; x + DIFF_BLOCK <= bytes; x += DIFF_BLOCK, dirty += 4)
+        flag_tiles(dirty, diff_mask_avx512(a + x, b + x), diff_mask_avx512(a + x + 64, b + x + 64),
+                   diff_mask_avx512(a + x + 128, b + x + 128));
+    diff_tiles(a + x, b + x, bytes - x, dirty);
+}
+
+static const conv_kernels sse2_kernels = {output_444_sse2, output_422_sse2, output_420_sse2, output_411_sse2,
+                                          output_410_sse2, diff_tiles_sse2};
+static const conv_kernels avx2_kernels = {output_444_avx2, output_422_avx2, output_420_avx2, output_411_avx2,
+                                          output_410_avx2, diff_tiles_avx2};
+static const conv_kernels avx512_kernels = {output_444_avx512, output_422_avx512, output_420_avx512,
+                                            output_411_avx512, output_410_avx512, diff_tiles_avx512};
+
+static inline unsigned long long xgetbv0(void) { // which register states the OS saves on context switches
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned int lo, hi;
+    __asm__ volatile ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+    return ((unsigned long long) hi << 32) | lo;
+#endif
+}
+
+static inline void cpuid_c(unsigned int leaf, unsigned int *regs) { // regs: eax, ebx, ecx, edx (subleaf 0)
+#ifdef _MSC_VER
+    __cpuidex((int *) regs, (int) leaf, 0);
+#else
+    __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+#endif // Y4M_X86
+
+typedef enum {
+    SIMD_NONE, SIMD_SSE2, SIMD_AVX2, SIMD_AVX512
+} simd_level;
+
+simd_level get_simd_level(void) { // highest instruction set extension both the CPU and the OS support
+    simd_level level = SIMD_NONE;
+#ifdef Y4M_X86
+    unsigned int regs[4];
+    cpuid_c(0, regs);
+    unsigned int max_leaf = regs[0];
+    cpuid_c(1, regs);
+    if (!(regs[3] & (1u << 26))) // SSE2
+        return level;
+    level = SIMD_SSE2;
+    if (max_leaf < 7 || !(regs[2] & (1u << 27)) || !(regs[2] & (1u << 28))) // OSXSAVE & AVX
+        return level;
+    unsigned long long xcr0 = xgetbv0();
+    if ((xcr0 & 0x6) != 0x6) // XMM & YMM state
+        return level;
+    cpuid_c(7, regs);
+    if (regs[1] & (1u << 5)) // AVX2
+        level = SIMD_AVX2;
+    else
+        return level;
+    if ((xcr0 & 0xe0) == 0xe0 && (regs[1] & (1u << 16)) && (regs[1] & (1u << 30))) // ZMM state, AVX512F & AVX512BW
+        level = SIMD_AVX512;
+#endif
+    return level;
+}
+
+const conv_kernels *get_kernels(conv_backend backend) { // aborts if the CPU can't run the requested backend
+    if (backend == CONV_REF)
+        return &ref_kernels;
+    if (backend == CONV_FIXED)
+        return &fixed_kernels;
+    if (backend == CONV_LUT) { // never chosen automatically, as the SIMD kernels are faster wherever they can run
+        init_lut();
+        return &lut_kernels;
+    }
+    simd_level level = get_simd_level();
+    if (backend == CONV_AUTO)
+        backend = level == SIMD_AVX512 ? CONV_AVX512 : (level == SIMD_AVX2 ? CONV_AVX2 :
+                  (level == SIMD_SSE2 ? CONV_SSE2 : CONV_FIXED));
+    if ((backend == CONV_SSE2 && level < SIMD_SSE2) || (backend == CONV_AVX2 && level < SIMD_AVX2) ||
+        (backend == CONV_AVX512 && level < SIMD_AVX512)) {
+        fprintf(stderr, BOLD_TXT(RED_TXT("Error:"))
+                        UNDERLINED_TXT(BLUE_TXT(" the requested conversion backend is not supported by this CPU.\n")));
+        abort();
+    }
+#ifdef Y4M_X86
+    if (backend == CONV_SSE2)
+        return &sse2_kernels;
+    if (backend == CONV_AVX2)
+        return &avx2_kernels;
+    if (backend == CONV_AVX512)
+        return &avx512_kernels;
+#endif
+    return &fixed_kernels;
+}
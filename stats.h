@@ -0,0 +1,116 @@
+//
+// per-stage timing statistics of a conversion, printed at the end with "-stats" (or "-stats=json")
+//
+
+#pragma once
+
+#include "overhead.h"
+
+/* Each frame's time in each stage is measured with get_time_ns() by whichever thread does the work: the read covers
+ * mapping (or reading in) the BMP & checking it, the conversion covers all of the frame's stripes (added up, so it's
+ * the CPU time spent on it even when its stripes were converted in parallel), & the write covers handing the frame to
+ * the output. The totals of the stages therefore add up to more than the elapsed time when they overlap, & each
+ * stage's MB/s is what a single thread manages while doing that stage - the bytes being the BMPs' for the read, their
+ * pixel arrays' for the conversion & the video's for the write. The scan & the sort are timed once, in main(). */
+
+#define NUM_STAGES 3
+
+typedef enum {
+    STAGE_READ, STAGE_CONVERT, STAGE_WRITE
+} frame_stage;
+
+static const char *const stage_names[NUM_STAGES] = {"read", "convert", "write"};
+
+typedef struct {
+    unsigned long long scan_ns; // finding the BMPs (or reading the list of them)
+    unsigned long long sort_ns;
+    unsigned long long elapsed_ns; // the whole run, from start-up to the video being closed
+    unsigned long long *frame_ns[NUM_STAGES]; // time spent on each frame, for each stage
+    unsigned long long total_ns[NUM_STAGES];
+    size_t bytes[NUM_STAGES];
+    size_t count; // number of frames recorded
+    size_t cap;
+} run_stats;
+
+void init_stats(run_stats *st) {
+    st->scan_ns = st->sort_ns = st->elapsed_ns = 0;
+    st->count = 0;
+    st->cap = 0;
+    for (int s = 0; s < NUM_STAGES; ++s) {
+        st->frame_ns[s] = NULL;
+        st->total_ns[s] = 0;
+        st->bytes[s] = 0;
+    }
+}
+
+// records a frame that has been written - only ever called by one thread at a time
+void add_frame_stats(run_stats *st, const unsigned long long *ns, const size_t *bytes) {
+    if (st->count == st->cap) {
+        st->cap = st->cap ? 2*st->cap : MIN_ARENA_SIZE/sizeof(unsigned long long);
+        for (int s = 0; s < NUM_STAGES; ++s) {
+            st->frame_ns[s] = realloc(st->frame_ns[s], st->cap*sizeof(unsigned long long));
+            if (!st->frame_ns[s]) {
+                fprintf(stderr, "Memory allocation error when recording the timing statistics.\n");
+                abort();
+            }
+        }
+    }
+    for (int s = 0; s < NUM_STAGES; ++s) {
+        *(st->frame_ns[s] + st->count) = *(ns + s);
+        st->total_ns[s] += *(ns + s);
+        st->bytes[s] += *(bytes + s);
+    }
+    ++st->count;
+}
+
+static int cmp_ns(const void *a, const void *b) {
+    unsigned long long x = *(const unsigned long long *) a;
+    unsigned long long y = *(const unsigned long long *) b;
+    return (x > y) - (x < y);
+}
+
+static double percentile_ms(const unsigned long long *sorted, size_t count, unsigned int pct) { // nearest rank
+    if (!count)
+        return 0;
+    size_t rank = (count*pct + 99)/100;
+    return *(sorted + (rank ? rank - 1 : 0))/1e6;
+}
+
+// prints the statistics as a table, or as a single line of JSON, sorting the per-frame times in the process
+void print_stats(run_stats *st, FILE *fp, bool json) {
+    static const unsigned int pcts[3] = {50, 90, 99};
+    if (json)
+        fprintf(fp, "{\"frames\": %zu, \"elapsed_ms\": %.3f, \"scan_ms\": %.3f, \"sort_ms\": %.3f, \"stages\": {",
+                st->count, st->elapsed_ns/1e6, st->scan_ns/1e6, st->sort_ns/1e6);
+    else
+        fprintf(fp, "Elapsed: %.3f ms over %zu frames (scan: %.3f ms, sort: %.3f ms)\n"
+                    "%-8s %12s %10s %10s %10s %10s %10s\n", st->elapsed_ns/1e6, st->count, st->scan_ns/1e6,
+                st->sort_ns/1e6, "Stage", "Total (ms)", "p50 (ms)", "p90 (ms)", "p99 (ms)", "Max (ms)", "MB/s");
+    for (int s = 0; s < NUM_STAGES; ++s) {
+        if (st->count)
+            qsort(st->frame_ns[s], st->count, sizeof(unsigned long long), cmp_ns);
+        double max_ms = st->count ? *(st->frame_ns[s] + st->count - 1)/1e6 : 0;
+        double mb_per_s = st->total_ns[s] ? st->bytes[s]/(st->total_ns[s]/1e9)/1e6 : 0;
+        if (json)
+            fprintf(fp, "%s\"%s\": {\"total_ms\": %.3f, \"p50_ms\": %.3f, \"p90_ms\": %.3f, \"p99_ms\": %.3f, "
+                        "\"max_ms\": %.3f, \"mb_per_s\": %.1f}", s ? ", " : "", stage_names[s], st->total_ns[s]/1e6,
+                    percentile_ms(st->frame_ns[s], st->count, pcts[0]),
+                    percentile_ms(st->frame_ns[s], st->count, pcts[1]),
+                    percentile_ms(st->frame_ns[s], st->count, pcts[2]), max_ms, mb_per_s);
+        else
+            fprintf(fp, "%-8s %12.3f %10.3f %10.3f %10.3f %10.3f %10.1f\n", stage_names[s], st->total_ns[s]/1e6,
+                    percentile_ms(st->frame_ns[s], st->count, pcts[0]),
+                    percentile_ms(st->frame_ns[s], st->count, pcts[1]),
+                    percentile_ms(st->frame_ns[s], st->count, pcts[2]), max_ms, mb_per_s);
+    }
+    if (json)
+        fprintf(fp, "}}\n");
+    fflush(fp);
+}
+
+void free_stats(run_stats *st) {
+    for (int s = 0; s < NUM_STAGES; ++s) {
+        free(st->frame_ns[s]);
+        st->frame_ns[s] = NULL;
+    }
+}
@@ -0,0 +1,156 @@
+//
+// bounded-memory alternative to the pipeline, converting & writing frames a band of rows at a time
+//
+
+#pragma once
+
+#include "pipeline.h"
+
+/* At most STREAM_ROWS rows of a frame (rounded down to whole row groups) are ever in memory, before and after
+ * conversion, so memory use grows with the width of the frames but not with their height, nor with the number of CPUs.
+ * A band's rows are stored contiguously in the BMP (bottom row first), so each one is read in with a single fread().
+ * The Y, Cb & Cr planes of a frame come one after the other in the video, so each band's share of every plane is
+ * written at its offset in the frame directly - the output therefore has to be seekable (& any failed seek or write
+ * aborts, as with the pipeline). With "-stats", each band's read, conversion & write are timed separately, & added up
+ * for the frame. With "-d", each BMP is handed over to be deleted in the background once its frame has been written,
+ * as in the pipeline. */
+#define STREAM_ROWS 16
+
+// reads the rows [row, row + num_rows) (in y4m order) of the BMP's pixel array, returning the first of them
+static inline const colour *read_band(const pipeline *pl, FILE *bmp, const char *path, size_t px_arr_offset,
+                                      unsigned char *rows, unsigned int row, unsigned int num_rows) {
+    size_t size = (num_rows - 1)*pl->row_size + pl->width*sizeof(colour); // the last row's padding isn't needed
+    if (fseek(bmp, (long) (px_arr_offset + (pl->height - row - num_rows)*pl->row_size), SEEK_SET) ||
+        fread(rows, sizeof(unsigned char), size, bmp) != size) {
+        fprintf(stderr, "Error reading from BMP image \"%s\".\n", path);
+        abort();
+    }
+    return (const colour *) (rows + (num_rows - 1)*pl->row_size);
+}
+
+// writes size bytes of a band's plane at offset in the video - errors abort, as for any other write of the video
+static inline void write_band(const video_out *out, const unsigned char *data, size_t size, long offset) {
+    if (fseek(out->fp, offset, SEEK_SET) || fwrite(data, sizeof(unsigned char), size, out->fp) != size)
+        video_write_error(out);
+}
+
+void run_stream(pipeline *pl, video_out *out) {
+    unsigned int band = STREAM_ROWS - STREAM_ROWS % pl->v_sub;
+    size_t chroma_width = pl->width/pl->h_sub;
+    size_t luma_size = ((size_t) pl->width)*pl->height;
+    size_t chroma_size = chroma_width*(pl->height/pl->v_sub);
+    size_t band_luma = ((size_t) pl->width)*band;
+    size_t band_chroma = chroma_width*(band/pl->v_sub);
+    unsigned char *rows = malloc(band*pl->row_size);
+    unsigned char *luma = malloc(band_luma + 2*band_chroma); // the band's Y, Cb & Cr, one after the other
+    if (!rows || !luma) {
+        fprintf(stderr, "Memory allocation error when setting up the row buffers.\n");
+        abort();
+    }
+    unsigned char *cb = luma + band_luma;
+    unsigned char *cr = cb + band_chroma;
+    unsigned char headers[sizeof(bmp_header) + sizeof(bmp_info_header)];
+    const char *path;
+    FILE *bmp;
+    long frame_start;
+    size_t px_arr_offset;
+    unsigned int num_rows;
+    const colour *input;
+    bool timed = pl->stats != NULL;
+    unsigned long long t0 = 0;
+    unsigned long long t1 = 0;
+    unsigned long long stage_ns[NUM_STAGES];
+    size_t stage_bytes[NUM_STAGES];
+    unsigned long long trace_ns;
+    deleter dl;
+    if (pl->del)
+        start_deleter(&dl, out->fp, -1, pl->sync_every, pl->ckpt);
+    progress pr;
+    size_t start_size = out->size;
+    if (pl->prog)
+        start_progress(&pr, pl->msgs, pl->prog_rate, pl->num_frames);
+    trace_thread_name("writer");
+    for (size_t i = 0; i < pl->num_frames; ++i) {
+        path = *(pl->paths + i);
+        if (timed) {
+            for (int s = 0; s < NUM_STAGES; ++s)
+                *(stage_ns + s) = 0;
+            t0 = get_time_ns();
+        }
+        trace_ns = trace_begin();
+        bmp = fopen(path, "rb");
+        if (!bmp) {
+            fprintf(stderr, "File \"%s\" could not be opened.\n", path);
+            abort();
+        }
+        fseek(bmp, 0, SEEK_END);
+        size_t size = (size_t) ftell(bmp);
+        rewind(bmp);
+        if (fread(headers, sizeof(unsigned char), sizeof(headers), bmp) != sizeof(headers))
+            size = 0; // too small to be a BMP, which check_bmp() reports
+        trace_end("open", i, trace_ns);
+        trace_ns = trace_begin();
+        px_arr_offset = check_bmp(headers, size, path, pl->bmp_width, pl->bmp_height, pl->row_size);
+        trace_end("check_bmp", i, trace_ns);
+        if (timed) {
+            t1 = get_time_ns();
+            *(stage_ns + STAGE_READ) += t1 - t0;
+            *(stage_bytes + STAGE_READ) = size;
+            *(stage_bytes + STAGE_WRITE) = out->size;
+        }
+        trace_ns = trace_begin();
+        write_video(out, frame_line, sizeof(frame_line) - 1); // each frame starts with "FRAME\n"
+        frame_start = (long) out->size;
+        trace_end("start_frame", i, trace_ns);
+        for (unsigned int row = 0; row < pl->height; row += num_rows) {
+            num_rows = pl->height - row < band ? pl->height - row : band; // always a multiple of v_sub
+            if (timed)
+                t0 = get_time_ns();
+            trace_ns = trace_begin();
+            input = read_band(pl, bmp, path, px_arr_offset, rows, row, num_rows);
+            trace_end("read_band", i, trace_ns);
+            if (timed) {
+                *(stage_ns + STAGE_WRITE) += t0 - t1; // since the previous band was read, or the headers were
+                t1 = get_time_ns();
+                *(stage_ns + STAGE_READ) += t1 - t0;
+            }
+            trace_ns = trace_begin();
+            pl->kernel(input, pl->stride, luma, cb, cr, pl->width, num_rows);
+            trace_end(pl->kernel_name, i, trace_ns);
+            if (timed) {
+                t0 = get_time_ns();
+                *(stage_ns + STAGE_CONVERT) += t0 - t1;
+                t1 = t0;
+            }
+            trace_ns = trace_begin();
+            write_band(out, luma, ((size_t) pl->width)*num_rows, frame_start + (long) (((size_t) pl->width)*row));
+            write_band(out, cb, chroma_width*(num_rows/pl->v_sub),
+                       frame_start + (long) (luma_size + chroma_width*(row/pl->v_sub)));
+            write_band(out, cr, chroma_width*(num_rows/pl->v_sub),
+                       frame_start + (long) (luma_size + chroma_size + chroma_width*(row/pl->v_sub)));
+            trace_end("fwrite", i, trace_ns);
+        }
+        if (fseek(out->fp, frame_start + (long) pl->frame_size, SEEK_SET)) // after the last band of the Cr plane
+            video_write_error(out);
+        out->size += pl->frame_size;
+        if (timed) {
+            *(stage_ns + STAGE_WRITE) += get_time_ns() - t1;
+            *(stage_bytes + STAGE_CONVERT) = ((size_t) pl->width)*pl->height*sizeof(colour);
+            *(stage_bytes + STAGE_WRITE) = out->size - *(stage_bytes + STAGE_WRITE);
+            add_frame_stats(pl->stats, stage_ns, stage_bytes);
+        }
+        fclose(bmp);
+        if (pl->del)
+            delete_when_written(&dl, path);
+        update_checkpoint(pl->ckpt, out->fp, pl->ckpt->base + i + 1, out->size, stop_requested);
+        if (stop_requested) // SIGINT - the rest of the frames are left to be resumed (the loop ends here)
+            pl->num_frames = i + 1;
+        if (pl->prog)
+            update_progress(&pr, i + 1, pl->num_frames, out->size - start_size);
+    }
+    if (pl->del)
+        stop_deleter(&dl);
+    if (pl->prog)
+        stop_progress(&pr);
+    free_ptrs(2, rows, luma);
+}
@@ -0,0 +1,197 @@
+//
+// thin wrappers around the native threading APIs (POSIX threads, or the Windows API when on Win.)
+//
+
+#pragma once
+
+#include "overhead.h"
+
+#ifdef _WIN32
+typedef HANDLE thread_t;
+typedef CRITICAL_SECTION mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+#else
+#include <pthread.h>
+typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+#endif
+
+typedef struct {
+    void (*func)(void *);
+    void *arg;
+} thread_start;
+
+#ifdef _WIN32
+static DWORD WINAPI thread_trampoline(LPVOID ptr) {
+#else
+static void *thread_trampoline(void *ptr) {
+#endif
+    thread_start start = *((thread_start *) ptr);
+    free(ptr);
+    start.func(start.arg);
+    return 0;
+}
+
+void thread_create(thread_t *thread, void (*func)(void *), void *arg) { // aborts if the thread can't be created
+    thread_start *start = malloc(sizeof(thread_start));
+    if (!start) {
+        fprintf(stderr, "Memory allocation error when creating thread.\n");
+        abort();
+    }
+    start->func = func;
+    start->arg = arg;
+#ifdef _WIN32
+    *thread = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+    if (*thread == NULL) {
+#else
+    sigset_t set;
+    sigset_t old_set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &set, &old_set); // the new thread starts with SIGINT blocked (see block_sigint())
+    int err = pthread_create(thread, NULL, thread_trampoline, start);
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+    if (err) {
+#endif
+        fprintf(stderr, "Error: could not create thread.\n");
+        abort();
+    }
+}
+
+/* blocks SIGINT in the calling thread if block is true, unblocks it otherwise. Threads start with it blocked, so that
+ * it can only interrupt the system calls of the main thread, unless another one unblocks it */
+static inline void block_sigint(bool block) {
+#ifndef _WIN32
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    pthread_sigmask(block ? SIG_BLOCK : SIG_UNBLOCK, &set, NULL);
+#else
+    (void) block;
+#endif
+}
+
+static inline void thread_join(thread_t thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+static inline void mutex_init(mutex_t *mutex) {
+#ifdef _WIN32
+    InitializeCriticalSection(mutex);
+#else
+    pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+static inline void mutex_lock(mutex_t *mutex) {
+#ifdef _WIN32
+    EnterCriticalSection(mutex);
+#else
+    pthread_mutex_lock(mutex);
+#endif
+}
+
+static inline void mutex_unlock(mutex_t *mutex) {
+#ifdef _WIN32
+    LeaveCriticalSection(mutex);
+#else
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+static inline void mutex_destroy(mutex_t *mutex) {
+#ifdef _WIN32
+    DeleteCriticalSection(mutex);
+#else
+    pthread_mutex_destroy(mutex);
+#endif
+}
+
+static inline void cond_init(cond_t *cond) {
+#ifdef _WIN32
+    InitializeConditionVariable(cond);
+#else
+    pthread_cond_init(cond, NULL);
+#endif
+}
+
+static inline void cond_wait(cond_t *cond, mutex_t *mutex) {
+#ifdef _WIN32
+    SleepConditionVariableCS(cond, mutex, INFINITE);
+#else
+    pthread_cond_wait(cond, mutex);
+#endif
+}
+
+static inline void cond_timed_wait(cond_t *cond, mutex_t *mutex, unsigned int ms) { // gives up after ms milliseconds
+#ifdef _WIN32
+    SleepConditionVariableCS(cond, mutex, ms);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts); // what pthread_cond_timedwait() measures against, by default
+    ts.tv_sec += ms/1000;
+    ts.tv_nsec += (long) (ms % 1000)*1000000l;
+    if (ts.tv_nsec >= 1000000000l) {
+        ++ts.tv_sec;
+        ts.tv_nsec -= 1000000000l;
+    }
+    pthread_cond_timedwait(cond, mutex, &ts);
+#endif
+}
+
+static inline void cond_broadcast(cond_t *cond) {
+#ifdef _WIN32
+    WakeAllConditionVariable(cond);
+#else
+    pthread_cond_broadcast(cond);
+#endif
+}
+
+static inline void cond_destroy(cond_t *cond) {
+#ifdef _WIN32
+    (void) cond; // Windows condition variables need no clean-up
+#else
+    pthread_cond_destroy(cond);
+#endif
+}
+
+/* A counter that one thread updates & others only ever read - none of them rely on it for ordering their other
+ * memory accesses, so relaxed loads & stores (which are plain moves on x86 & ARM) are all that's needed. */
+#ifdef _MSC_VER
+typedef volatile size_t atomic_count; // aligned loads & stores of a machine word are atomic on all of MSVC's targets
+
+static inline void store_count(atomic_count *count, size_t val) {
+    *count = val;
+}
+
+static inline size_t load_count(const atomic_count *count) {
+    return *count;
+}
+#else
+typedef size_t atomic_count;
+
+static inline void store_count(atomic_count *count, size_t val) {
+    __atomic_store_n(count, val, __ATOMIC_RELAXED);
+}
+
+static inline size_t load_count(const atomic_count *count) {
+    return __atomic_load_n(count, __ATOMIC_RELAXED);
+}
+#endif
+
+unsigned int get_num_cpus(void) { // number of online logical processors (at least 1)
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? info.dwNumberOfProcessors : 1;
+#else
+    long num = sysconf(_SC_NPROCESSORS_ONLN);
+    return num > 0 ? (unsigned int) num : 1;
+#endif
+}
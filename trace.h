@@ -0,0 +1,171 @@
+//
+// timeline of the work done on each frame by each thread, written out for chrome://tracing or Perfetto ("-trace")
+//
+
+#pragma once
+
+#include "threads.h"
+
+/* Each thread records its events in a buffer of its own, found through a thread-local pointer, so recording an event
+ * takes no lock at all - just two reads of the clock & a store. The buffers are chunked lists, so they never have to
+ * be moved as they grow, & the lock is only taken by a thread the first time it records something, to add its buffer
+ * to the list of all of them. Nothing is written out until finish_trace(), once all the threads other than the calling
+ * one are done, in the Trace Event Format's JSON form: each event is a complete ("X") event, i.e. a begin & an end,
+ * tagged with the frame it was for, & each thread is named after its role in the conversion. */
+
+#define TRACE_CHUNK 4096 // number of events in each chunk of a thread's buffer
+#define TRACE_NO_FRAME ((size_t) -1) // for events that aren't for any one frame
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+typedef struct {
+    const char *name; // must be a string literal (or otherwise outlive the trace)
+    size_t frame;
+    unsigned long long beg_ns;
+    unsigned long long end_ns;
+} trace_event;
+
+typedef struct trace_chunk {
+    trace_event events[TRACE_CHUNK];
+    struct trace_chunk *next;
+} trace_chunk;
+
+typedef struct trace_buf {
+    const char *thread_name;
+    unsigned int tid; // order the threads recorded their first events in
+    trace_chunk *head;
+    trace_chunk *tail;
+    unsigned int count; // number of events in the tail chunk
+    struct trace_buf *next;
+} trace_buf;
+
+typedef struct {
+    FILE *fp; // NULL when not tracing
+    const char *path;
+    unsigned long long start_ns; // timestamps are written relative to this
+    mutex_t lock; // only guards the list of buffers
+    trace_buf *bufs;
+    unsigned int num_bufs;
+} trace_log;
+
+static trace_log tracer = {0};
+static THREAD_LOCAL trace_buf *own_trace_buf = NULL;
+
+// starts tracing into the file at path - returns false (with an error printed) if it can't be created
+bool start_trace(const char *path) {
+    tracer.fp = fopen(path, "w");
+    if (!tracer.fp) {
+        fprintf(stderr, "Trace file \"%s\" could not be created.\n", path);
+        perror("Error");
+        return false;
+    }
+    tracer.path = path;
+    tracer.start_ns = get_time_ns();
+    tracer.bufs = NULL;
+    tracer.num_bufs = 0;
+    mutex_init(&tracer.lock);
+    return true;
+}
+
+static inline bool tracing(void) {
+    return tracer.fp != NULL;
+}
+
+static trace_buf *get_trace_buf(void) { // the calling thread's buffer, set up on its first call
+    if (own_trace_buf)
+        return own_trace_buf;
+    trace_buf *buf = malloc(sizeof(trace_buf));
+    trace_chunk *chunk = malloc(sizeof(trace_chunk));
+    if (!buf || !chunk) {
+        fprintf(stderr, "Memory allocation error when tracing.\n");
+        abort();
+    }
+    chunk->next = NULL;
+    buf->thread_name = "thread";
+    buf->head = buf->tail = chunk;
+    buf->count = 0;
+    mutex_lock(&tracer.lock);
+    buf->tid = tracer.num_bufs++;
+    buf->next = tracer.bufs;
+    tracer.bufs = buf;
+    mutex_unlock(&tracer.lock);
+    return own_trace_buf = buf;
+}
+
+static inline void trace_thread_name(const char *name) { // names the calling thread in the timeline
+    if (tracing())
+        get_trace_buf()->thread_name = name;
+}
+
+static inline unsigned long long trace_begin(void) { // the start of an event, to pass to trace_end()
+    return tracing() ? get_time_ns() : 0;
+}
+
+static void trace_end(const char *name, size_t frame, unsigned long long beg_ns) {
+    if (!tracing())
+        return;
+    unsigned long long end_ns = get_time_ns();
+    trace_buf *buf = get_trace_buf();
+    if (buf->count == TRACE_CHUNK) {
+        trace_chunk *chunk = malloc(sizeof(trace_chunk));
+        if (!chunk) {
+            fprintf(stderr, "Memory allocation error when tracing.\n");
+            abort();
+        }
+        chunk->next = NULL;
+        buf->tail->next = chunk;
+        buf->tail = chunk;
+        buf->count = 0;
+    }
+    trace_event *event = buf->tail->events + buf->count++;
+    event->name = name;
+    event->frame = frame;
+    event->beg_ns = beg_ns;
+    event->end_ns = end_ns;
+}
+
+// writes out & frees all the events recorded - no other thread may be recording any by now
+void finish_trace(void) {
+    if (!tracing())
+        return;
+    FILE *fp = tracer.fp;
+    bool first = true;
+    fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (trace_buf *buf = tracer.bufs; buf; buf = buf->next) {
+        fprintf(fp, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, "
+                    "\"args\": {\"name\": \"%s %u\"}}", first ? "" : ",\n", buf->tid, buf->thread_name, buf->tid);
+        first = false;
+        for (trace_chunk *chunk = buf->head; chunk; chunk = chunk->next) {
+            unsigned int count = chunk == buf->tail ? buf->count : TRACE_CHUNK;
+            for (const trace_event *event = chunk->events; event < chunk->events + count; ++event) {
+                fprintf(fp, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, "
+                            "\"dur\": %.3f", event->name, buf->tid, (event->beg_ns - tracer.start_ns)/1e3,
+                        (event->end_ns - event->beg_ns)/1e3);
+                if (event->frame != TRACE_NO_FRAME)
+                    fprintf(fp, ", \"args\": {\"frame\": %zu}", event->frame);
+                fputc('}', fp);
+            }
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    if (fclose(fp))
+        fprintf(stderr, "Error writing trace file \"%s\".\n", tracer.path);
+    tracer.fp = NULL;
+    trace_chunk *next_chunk;
+    trace_buf *next_buf;
+    for (trace_buf *buf = tracer.bufs; buf; buf = next_buf) {
+        next_buf = buf->next;
+        for (trace_chunk *chunk = buf->head; chunk; chunk = next_chunk) {
+            next_chunk = chunk->next;
+            free(chunk);
+        }
+        free(buf);
+    }
+    tracer.bufs = NULL;
+    mutex_destroy(&tracer.lock);
+    own_trace_buf = NULL;
+}
@@ -0,0 +1,252 @@
+//
+// watching a directory for BMPs as they're rendered, so that they can be converted without waiting for the whole render
+//
+
+#pragma once
+
+#include "scan.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#endif
+
+#define WATCH_BUF_SIZE (1 << 16) // size of the buffer inotify events are read into
+#define DEF_SENTINEL "DONE" // name of the file that marks the end of the render, unless given with "-sentinel="
+#define DEF_WATCH_TIMEOUT 60 // seconds without a new BMP after which the watch ends, unless given with "-timeout="
+#define WATCH_POLL_MS 100 // longest wait for events before checking whether the conversion has been interrupted
+
+/* A BMP is only taken once it has been closed after being written (IN_CLOSE_WRITE), or once it has been renamed into
+ * the directory (IN_MOVED_TO), so half-written frames are never read. The BMPs already in the directory when the watch
+ * starts are taken first - those the header of which gives a larger size than the file has are still being written, &
+ * are left for their IN_CLOSE_WRITE event. Frames are converted in the order they're finished, except that those which
+ * are waiting to be converted are kept in sort order, so frames finished slightly out of order (e.g. by several render
+ * nodes) are still put in the right order. A hash of each name is kept, so a BMP is never taken twice, even if it's
+ * written to again. The watch ends once a file named after the sentinel appears in the directory, or once no new BMP
+ * has appeared for the timeout - in both cases only after all the BMPs found so far have been converted. */
+typedef struct {
+    int fd; // the inotify instance
+    char *dir; // copy of the path of the directory, ending in a file separator
+    size_t dir_len;
+    const char *sentinel;
+    unsigned int timeout; // in seconds
+    bool natural; // whether the BMPs waiting to be converted are sorted in natural order rather than alphabetically
+    char **queue; // paths of the BMPs found, those from head onwards not having been handed out yet (NULL-terminated)
+    size_t head;
+    size_t count;
+    size_t queue_cap;
+    unsigned long long *seen; // open-addressed set of hashes of the names of all BMPs queued (0 marks empty entries)
+    size_t seen_cap;
+    size_t num_seen;
+    bool ended; // whether the sentinel has appeared or the timeout has passed
+    unsigned long long last_ns; // time the last BMP was found at
+    char *buf; // inotify events are read into this
+} dir_watch;
+
+static unsigned long long hash_name(const char *name) { // FNV-1a, never returning 0
+    unsigned long long hash = 0xcbf29ce484222325ull;
+    while (*name)
+        hash = (hash ^ (unsigned char) *name++)*0x100000001b3ull;
+    return hash ? hash : 1;
+}
+
+static bool add_seen(dir_watch *w, unsigned long long hash) { // returns false if the hash was already in the set
+    if (2*(w->num_seen + 1) > w->seen_cap) { // rehash into a table twice the size, keeping it at most half full
+        size_t old_cap = w->seen_cap;
+        unsigned long long *old = w->seen;
+        w->seen_cap *= 2;
+        w->seen = calloc(w->seen_cap, sizeof(unsigned long long));
+        if (!w->seen) {
+            fprintf(stderr, "Memory allocation error when watching the directory.\n");
+            abort();
+        }
+        w->num_seen = 0;
+        for (size_t i = 0; i < old_cap; ++i)
+            if (*(old + i))
+                add_seen(w, *(old + i));
+        free(old);
+    }
+    size_t i = (size_t) (hash & (w->seen_cap - 1));
+    for (; *(w->seen + i); i = (i + 1) & (w->seen_cap - 1))
+        if (*(w->seen + i) == hash)
+            return false;
+    *(w->seen + i) = hash;
+    ++w->num_seen;
+    return true;
+}
+
+static void queue_bmp(dir_watch *w, const char *name) { // name is relative to the directory
+    if (!add_seen(w, hash_name(name)))
+        return;
+    if (w->count + 1 == w->queue_cap) {
+        w->queue_cap *= 2;
+        w->queue = realloc(w->queue, w->queue_cap*sizeof(char *));
+    }
+    char *path = malloc(w->dir_len + strlen_c(name) + 1);
+    if (!w->queue || !path) {
+        fprintf(stderr, "Memory allocation error when watching the directory.\n");
+        abort();
+    }
+    strcpy_c(path, w->dir);
+    strcat_c(path, name);
+    *(w->queue + w->count++) = path;
+    *(w->queue + w->count) = NULL;
+    w->last_ns = get_time_ns();
+}
+
+static bool bmp_complete(const char *path) { // whether the file is at least as big as its header says it is
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return false;
+    bmp_header header;
+    bool complete = fread(&header, sizeof(char), sizeof(header), fp) == sizeof(header);
+    fseek(fp, 0, SEEK_END);
+    complete = complete && ftell(fp) >= (long) header.fileSize;
+    fclose(fp);
+    return complete;
+}
+
+#ifdef __linux__
+static void read_events(dir_watch *w) { // waits for (at most until the timeout) & processes the next batch of events
+    if (stop_requested) { // SIGINT
+        w->ended = true;
+        return;
+    }
+    long long wait_ms = (long long) w->timeout*1000 - (long long) ((get_time_ns() - w->last_ns)/1000000);
+    struct pollfd pfd = {w->fd, POLLIN, 0};
+    int ready = wait_ms > 0 ? poll(&pfd, 1, wait_ms > WATCH_POLL_MS ? WATCH_POLL_MS : (int) wait_ms) : 0;
+    if (ready == -1 && errno == EINTR)
+        return;
+    if (ready == -1) {
+        fprintf(stderr, "Error waiting for events in directory \"%s\".\n", w->dir);
+        perror("Error");
+        abort();
+    }
+    if (ready == 0) {
+        w->ended = wait_ms <= WATCH_POLL_MS; // timed out
+        return;
+    }
+    ssize_t num_read = read(w->fd, w->buf, WATCH_BUF_SIZE);
+    if (num_read <= 0) {
+        if (num_read == -1 && errno == EINTR)
+            return;
+        fprintf(stderr, "Error reading events for directory \"%s\".\n", w->dir);
+        perror("Error");
+        abort();
+    }
+    size_t old_head = w->head;
+    const struct inotify_event *event;
+    for (char *ptr = w->buf; ptr < w->buf + num_read; ptr += sizeof(struct inotify_event) + event->len) {
+        event = (const struct inotify_event *) ptr;
+        if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) { // the directory itself has gone
+            w->ended = true;
+            break;
+        }
+        if (!event->len || (event->mask & IN_ISDIR))
+            continue;
+        if (equal(event->name, w->sentinel)) { // any BMPs finished after the sentinel appeared are left out
+            w->ended = true;
+            break;
+        }
+        if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) && endswith(event->name, ".bmp"))
+            queue_bmp(w, event->name);
+    }
+    if (w->count - old_head > 1) // puts frames finished out of order back in order (see above)
+        (w->natural ? natural_sort : alphabetical_sort)((const char **) (w->queue + old_head));
+}
+#endif
+
+/* starts watching the directory at dir (which must end in a file separator), queueing the complete BMPs already in it,
+ * in sort order. Returns false (with an error printed) if the directory can't be watched */
+bool start_watch(dir_watch *w, const char *dir, const char *sentinel, unsigned int timeout, bool natural) {
+    w->dir_len = strlen_c(dir);
+    w->dir = malloc(w->dir_len + 1);
+    w->sentinel = sentinel;
+    w->timeout = timeout;
+    w->natural = natural;
+    w->head = 0;
+    w->count = 0;
+    w->queue_cap = MIN_ARENA_SIZE/sizeof(char *);
+    w->queue = malloc(w->queue_cap*sizeof(char *));
+    w->seen_cap = MIN_ARENA_SIZE/sizeof(unsigned long long); // a power of 2
+    w->num_seen = 0;
+    w->seen = calloc(w->seen_cap, sizeof(unsigned long long));
+    w->buf = malloc(WATCH_BUF_SIZE);
+    w->ended = false;
+    w->last_ns = get_time_ns();
+    if (!w->dir || !w->queue || !w->seen || !w->buf) {
+        fprintf(stderr, "Memory allocation error when watching the directory.\n");
+        abort();
+    }
+    strcpy_c(w->dir, dir);
+    *w->queue = NULL;
+#ifdef __linux__
+    w->fd = inotify_init1(IN_CLOEXEC);
+    // watching starts before the scan below, so that no BMP can be finished in between without being noticed
+    if (w->fd == -1 || inotify_add_watch(w->fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE_SELF |
+                                                     IN_MOVE_SELF | IN_ONLYDIR) == -1) {
+        fprintf(stderr, "Could not watch directory \"%s\".\n", dir);
+        perror("Error");
+        if (w->fd != -1)
+            close(w->fd);
+        free_ptrs(4, w->dir, w->queue, w->seen, w->buf);
+        return false;
+    }
+#endif
+    size_t num_found;
+    const char **found = scan_bmps(dir, &num_found);
+    if (!found)
+        return false;
+    if (natural)
+        natural_sort(found);
+    else
+        alphabetical_sort(found);
+    for (const char **path = found; *path; ++path)
+        if (bmp_complete(*path))
+            queue_bmp(w, *path + w->dir_len);
+    free(found);
+    char *sentinel_path = malloc(w->dir_len + strlen_c(sentinel) + 1);
+    if (!sentinel_path) {
+        fprintf(stderr, "Memory allocation error when watching the directory.\n");
+        abort();
+    }
+    strcpy_c(sentinel_path, dir);
+    strcat_c(sentinel_path, sentinel);
+    FILE *fp = fopen(sentinel_path, "rb");
+    if (fp) { // the render has already finished
+        w->ended = true;
+        fclose(fp);
+    }
+    free(sentinel_path);
+    return true;
+}
+
+// returns the path of the next BMP to convert, waiting for one to be finished if need be, or NULL once the watch ends
+const char *peek_watched_bmp(dir_watch *w) {
+#ifdef __linux__
+    while (w->head == w->count && !w->ended)
+        read_events(w);
+#endif
+    return w->head < w->count ? *(w->queue + w->head) : NULL;
+}
+
+// as above, but moving on to the BMP after - the path returned stays valid until the next call
+const char *next_watched_bmp(dir_watch *w) {
+    if (w->head) { // the previous path has been finished with
+        free(*(w->queue + w->head - 1));
+        *(w->queue + w->head - 1) = NULL;
+    }
+    const char *path = peek_watched_bmp(w);
+    if (path)
+        ++w->head;
+    return path;
+}
+
+void stop_watch(dir_watch *w) {
+    for (size_t i = 0; i < w->count; ++i) // those handed out & finished with are already NULL
+        free(*(w->queue + i));
+    free_ptrs(4, w->dir, w->queue, w->seen, w->buf);
+#ifdef __linux__
+    close(w->fd);
+#endif
+}